@@ -0,0 +1,96 @@
+#!/bin/sh
+# Report where the audio path landed in a cross-built firmware ELF, and fail
+# if any hot symbol sits outside ITCM (code) or DTCM (data). Hot functions
+# with no symbol of their own were inlined into a caller and are reported as
+# such, as are constant tables the compiler folded into the code; any other
+# missing data symbol is an error.
+#
+# The libm calls are the one accepted exception: ResonatorBank::SetFreq and
+# LadderFilter::StageGain call tanf, and AdditiveBank::SetFreq calls cosf and
+# sinf, from flash. SetFreq only gets there on a pitch change and StageGain
+# once per filtered block, so the cost is a few cached flash fetches per block
+# at most, not per sample.
+#
+# Usage: check_tcm.sh build/subharmonicon.elf
+# Set CROSS to override the toolchain prefix (default arm-none-eabi-).
+
+set -eu
+
+if [ $# -ne 1 ]; then
+    echo "usage: $0 firmware.elf" >&2
+    exit 2
+fi
+
+ELF=$1
+CROSS=${CROSS-arm-none-eabi-}
+
+HOT_CODE="AudioCallback Quantize CvToFrequency SineBank::Process ResonatorBank::Process
+AdditiveBank::BeginBlock AdditiveBank::Process SubharmonicEngine::ProcessBlock ScopeCapture::Process
+SpectrumAnalyzer::Capture TripleBuffer<EngineParams>::Acquire Seqlock<TunerSnapshot>::Write
+Waveshaper::Process LadderFilter::BeginBlock LadderFilter::Process
+Envelope::BeginBlock SineBank::SetFreq ResonatorBank::SetFreq AdditiveBank::SetFreq LadderFilter::StageGain
+Envelope::Fall Envelope::Next HalfBand<4u>::Paths HalfBand<8u>::Paths HalfBand<4u>::Upsample
+HalfBand<8u>::Upsample HalfBand<4u>::Downsample HalfBand<8u>::Downsample Shape SoftClip SinCycle WrapCycle
+FastExp2"
+HOT_DATA="engine pitch_block traced_freq sample_clock"
+HOT_TABLES="halfband_2x halfband_4x"
+
+SECTIONS=$("${CROSS}size" -A -x "$ELF")
+SYMBOLS=$("${CROSS}nm" -C -S "$ELF")
+
+echo "Sections:"
+echo "$SECTIONS" | awk '$1 ~ /^\.(isr_vector|itcm_text|dtcm_data|text|rodata|data|bss|dtcmram_bss|sram1_bss|sdram_bss)$/'
+echo
+
+echo "$SYMBOLS" | awk -v code="$HOT_CODE" -v data="$HOT_DATA" -v tables="$HOT_TABLES" '
+BEGIN {
+    nc = split(code, code_names)
+    nd = split(data, data_names)
+    nt = split(tables, table_names)
+}
+{
+    # nm -S: address size type name...; strip any argument list
+    if (NF < 4)
+        next
+    name = $4
+    for (i = 5; i <= NF; i++)
+        name = name " " $i
+    sub(/\(.*$/, "", name)
+    addr[name] = $1
+}
+function hex(s,    i, v) {
+    v = 0
+    s = tolower(s)
+    for (i = 1; i <= length(s); i++)
+        v = v * 16 + index("0123456789abcdef", substr(s, i, 1)) - 1
+    return v
+}
+function check(name, lo, hi, region, absent,    a) {
+    if (!(name in addr)) {
+        printf "  %-40s %s\n", name, absent != "" ? absent : "MISSING"
+        return absent == ""
+    }
+    a = hex(addr[name])
+    if (a >= lo && a < hi) {
+        printf "  %-40s 0x%08x  %s\n", name, a, region
+        return 0
+    }
+    printf "  %-40s 0x%08x  OUTSIDE %s\n", name, a, region
+    return 1
+}
+END {
+    # Bounds go through hex() too; mawk has no hex constants
+    bad = 0
+    print "Hot code:"
+    for (i = 1; i <= nc; i++)
+        bad += check(code_names[i], hex("00000000"), hex("00010000"), "ITCM", "inlined")
+    print "Hot data:"
+    for (i = 1; i <= nd; i++)
+        bad += check(data_names[i], hex("20000000"), hex("20020000"), "DTCM", "")
+    for (i = 1; i <= nt; i++)
+        bad += check(table_names[i], hex("20000000"), hex("20020000"), "DTCM", "folded")
+    if (bad > 0) {
+        printf "\n%d hot symbol(s) outside tightly coupled memory\n", bad
+        exit 1
+    }
+}'
@@ -0,0 +1,363 @@
+// Parallel batch renderer
+//
+// Sweeps the voice across every scale, every root note and a set of pitch CV
+// trajectories, rendering each combination as an independent job on its own
+// SubharmonicEngine. Jobs are dealt out in contiguous runs to per-thread
+// deques; a thread works through its own run from the back and, once empty,
+// steals from the front of the others, so uneven job costs still keep every
+// core busy. Each job writes one CSV line to stdout with its output hash,
+// peak level and render cost; a summary goes to stderr.
+//
+// Output hashes don't depend on the thread count, so two builds can be
+// compared by diffing the CSV with the cost column cut. Cost is in TSC
+// cycles per sample on x86 and nanoseconds per sample elsewhere. Running the
+// oscillator mode once per FM preset gives the cost per routed source, and
+// once per shaper preset the cost of each oversampling factor. The additive
+// mode takes a partial count, so a run per count gives its cost per partial.
+//
+// Build (from the repository root):
+//   g++ -std=c++17 -O2 -pthread -DSUBHARMONIC_HOST -I. -I$LIBDAISY/src -I$DAISYSP/Source
+//       host/batch_render.cpp oled_fonts.o -L$DAISYSP/build -ldaisysp -o batch_render
+//
+// Usage:
+//   batch_render [trajectories] [seconds] [threads] [voice_mode] [fm_preset] [fm_depth] [shaper] [drive] [partials] > results.csv
+
+#include "../subharmonicon.cpp"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace
+{
+constexpr float kSampleRate = 48000.0f;
+constexpr size_t kBlockSize = 48;
+constexpr size_t kNumRoots = kNumNotes * kNumOctaves;   // Every root the menu offers
+constexpr size_t kNumTrajectoryKinds = 6;
+
+#if defined(__x86_64__) || defined(__i386__)
+constexpr const char* kCostUnit = "cycles";
+uint64_t ReadCost() { return __rdtsc(); }
+#else
+constexpr const char* kCostUnit = "ns";
+uint64_t ReadCost()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+#endif
+
+// Small deterministic generator for trajectory steps and excitation noise
+struct Lcg
+{
+    uint32_t state;
+
+    float Next() // 0..1
+    {
+        state = state * 1664525u + 1013904223u;
+        return static_cast<float>(state >> 8) / 16777216.0f;
+    }
+};
+
+// Pitch CV trajectory, as raw readings (0..1 spans the 0..5V input). The
+// kind cycles with the index; later indices of the same kind move its centre.
+struct Trajectory
+{
+    size_t kind = 0;
+    float centre = 0.5f;
+    float phase = 0.0f;
+    float value = 0.0f;
+    uint32_t sample = 0;
+    uint32_t length = 1;
+    Lcg rng = {1};
+
+    void Init(size_t index, uint32_t num_samples)
+    {
+        kind = index % kNumTrajectoryKinds;
+        centre = 0.2f + 0.6f * std::fmod(0.5f + 0.618034f * static_cast<float>(index / kNumTrajectoryKinds), 1.0f);
+        phase = 0.0f;
+        sample = 0;
+        length = std::max<uint32_t>(num_samples, 1);
+        rng.state = static_cast<uint32_t>(index) * 2654435761u + 1u;
+        value = centre;
+    }
+
+    float Next()
+    {
+        float t = static_cast<float>(sample) / static_cast<float>(length);
+        switch (kind)
+        {
+            case 0: value = centre; break;                          // Held note
+            case 1: value = 0.1f + 0.8f * t; break;                  // Rising sweep
+            case 2: value = 0.9f - 0.8f * t; break;                  // Falling sweep
+            case 3: value = centre + 0.15f * sinf(TWOPI_F * phase); phase += 0.5f / kSampleRate; break;
+            case 4: value = centre + 0.004f * sinf(TWOPI_F * phase); phase += 6.0f / kSampleRate; break;
+            default:                                                 // Stepped, new note every 100 ms
+                if (sample % static_cast<uint32_t>(kSampleRate / 10.0f) == 0)
+                    value = 0.1f + 0.8f * rng.Next();
+                break;
+        }
+        if (phase >= 1.0f)
+            phase -= 1.0f;
+        sample++;
+        return value;
+    }
+};
+
+struct Job
+{
+    size_t scale;
+    int root;
+    size_t trajectory;
+};
+
+struct JobResult
+{
+    uint32_t hash = 0;
+    float peak = 0.0f;
+    double cost_per_sample = 0.0;
+};
+
+// Per-thread deque of job indices. The owner pops from the back and thieves
+// take from the front, so they only meet on the last job. Jobs are coarse, so
+// a mutex per deque costs nothing measurable.
+struct WorkQueue
+{
+    std::mutex lock;
+    std::deque<uint32_t> jobs;
+    size_t steals = 0;   // Jobs this thread took from others
+
+    bool PopBack(uint32_t& job)
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        if (jobs.empty())
+            return false;
+        job = jobs.back();
+        jobs.pop_back();
+        return true;
+    }
+
+    bool StealFront(uint32_t& job)
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        if (jobs.empty())
+            return false;
+        job = jobs.front();
+        jobs.pop_front();
+        return true;
+    }
+};
+
+// Everything a thread renders with; each job starts it from a clean Init()
+struct Worker
+{
+    SubharmonicEngine engine;
+    EngineParams params;
+    float pitch[kBlockSize];
+    float input[kBlockSize];
+    float out_l[kBlockSize];
+    float out_r[kBlockSize];
+};
+
+size_t num_trajectories = 8;
+float seconds = 0.25f;
+VoiceMode batch_voice_mode = VoiceMode::OSCILLATORS;
+size_t batch_fm_preset = 0;
+int batch_fm_depth = 50;
+size_t batch_shaper_preset = 0;
+int batch_shaper_drive = 25;
+size_t batch_partials = kDefaultPartials;
+std::vector<std::unique_ptr<WorkQueue>> queues;
+std::vector<JobResult> results;
+
+Job DecodeJob(uint32_t index)
+{
+    Job job;
+    job.trajectory = index % num_trajectories;
+    index /= static_cast<uint32_t>(num_trajectories);
+    job.root = static_cast<int>(index % kNumRoots);
+    job.scale = index / kNumRoots;
+    return job;
+}
+
+void RenderJob(Worker& w, uint32_t index)
+{
+    Job job = DecodeJob(index);
+    uint32_t num_samples = static_cast<uint32_t>(seconds * kSampleRate);
+
+    w.params.voice_mode = batch_voice_mode;
+    BuildCvTable(default_calibration, w.params.cv_table);
+    BuildTuningTable(w.params.tuning, 0, job.scale, job.root);
+    BuildFmMatrix(w.params, batch_fm_preset, static_cast<float>(batch_fm_depth) / kFmMaxDepth);
+    BuildShaper(w.params, batch_shaper_preset, static_cast<float>(batch_shaper_drive) / kShaperMaxDrive);
+    BuildPartials(w.params, batch_partials);
+    w.engine.Init(kSampleRate);
+    w.engine.SetParams(w.params);
+
+    Trajectory trajectory;
+    trajectory.Init(job.trajectory, num_samples);
+    Lcg noise = {static_cast<uint32_t>(index) + 1u};
+
+    JobResult& r = results[index];
+    uint32_t hash = 2166136261u;
+    float peak = 0.0f;
+    uint64_t cost = 0;
+
+    for (uint32_t done = 0; done < num_samples; done += kBlockSize)
+    {
+        size_t n = std::min<size_t>(kBlockSize, num_samples - done);
+        for (size_t i = 0; i < n; i++)
+        {
+            w.pitch[i] = trajectory.Next();
+            w.input[i] = 0.1f * (noise.Next() - 0.5f); // Resonator excitation
+        }
+
+        uint64_t start = ReadCost();
+        w.engine.ProcessBlock(w.input, w.pitch, w.out_l, w.out_r, n);
+        cost += ReadCost() - start;
+
+        for (size_t i = 0; i < n; i++)
+        {
+            uint32_t bits[2];
+            std::memcpy(&bits[0], &w.out_l[i], sizeof(float));
+            std::memcpy(&bits[1], &w.out_r[i], sizeof(float));
+            hash = (hash ^ bits[0]) * 16777619u;
+            hash = (hash ^ bits[1]) * 16777619u;
+            // A non-finite sample makes the peak non-finite too
+            float level = std::fmax(std::fabs(w.out_l[i]), std::fabs(w.out_r[i]));
+            if (level > peak || !std::isfinite(level))
+                peak = level;
+        }
+    }
+
+    r.hash = hash;
+    r.peak = peak;
+    r.cost_per_sample = num_samples ? static_cast<double>(cost) / num_samples : 0.0;
+}
+
+void WorkerThread(size_t self)
+{
+    std::unique_ptr<Worker> w(new Worker);
+    WorkQueue& own = *queues[self];
+    uint32_t job;
+
+    while (true)
+    {
+        if (own.PopBack(job))
+        {
+            RenderJob(*w, job);
+            continue;
+        }
+
+        // Nothing left locally: steal from the others in turn. No job makes
+        // new ones, so a full round that finds nothing means the sweep is done.
+        bool stole = false;
+        for (size_t k = 1; k < queues.size() && !stole; k++)
+            stole = queues[(self + k) % queues.size()]->StealFront(job);
+        if (!stole)
+            return;
+        own.steals++;
+        RenderJob(*w, job);
+    }
+}
+} // namespace
+
+int main(int argc, char** argv)
+{
+    if (argc > 1)
+        num_trajectories = std::max(1, std::atoi(argv[1]));
+    if (argc > 2)
+        seconds = static_cast<float>(std::atof(argv[2]));
+    size_t num_threads = (argc > 3) ? static_cast<size_t>(std::atoi(argv[3])) : std::thread::hardware_concurrency();
+    num_threads = std::max<size_t>(num_threads, 1);
+    if (argc > 4)
+        batch_voice_mode = static_cast<VoiceMode>(std::min<size_t>(std::atoi(argv[4]), kNumVoiceModes - 1));
+    if (argc > 5)
+        batch_fm_preset = std::min<size_t>(std::atoi(argv[5]), kNumFmPresets - 1);
+    if (argc > 6)
+        batch_fm_depth = std::max(0, std::min(kFmMaxDepth, std::atoi(argv[6])));
+    if (argc > 7)
+        batch_shaper_preset = std::min<size_t>(std::atoi(argv[7]), kNumShaperPresets - 1);
+    if (argc > 8)
+        batch_shaper_drive = std::max(0, std::min(kShaperMaxDrive, std::atoi(argv[8])));
+    if (argc > 9)
+        batch_partials = std::max(kMinPartials, std::min<size_t>(std::atoi(argv[9]), kMaxPartials));
+
+    const uint32_t num_jobs = static_cast<uint32_t>(kNumScales * kNumRoots * num_trajectories);
+    results.resize(num_jobs);
+
+    // Deal contiguous runs so neighbouring (similarly priced) jobs start on
+    // the same thread and stealing has real imbalance to correct
+    for (size_t t = 0; t < num_threads; t++)
+    {
+        queues.emplace_back(new WorkQueue);
+        uint32_t first = static_cast<uint32_t>(uint64_t(num_jobs) * t / num_threads);
+        uint32_t last = static_cast<uint32_t>(uint64_t(num_jobs) * (t + 1) / num_threads);
+        for (uint32_t j = first; j < last; j++)
+            queues[t]->jobs.push_back(j);
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> threads;
+    for (size_t t = 0; t < num_threads; t++)
+        threads.emplace_back(WorkerThread, t);
+    for (std::thread& thread : threads)
+        thread.join();
+    double wall_s = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    std::printf("job,scale,root,trajectory,hash,peak,%s_per_sample\n", kCostUnit);
+    size_t non_finite = 0, worst_job = 0;
+    double total_cost = 0.0;
+    for (uint32_t j = 0; j < num_jobs; j++)
+    {
+        const Job job = DecodeJob(j);
+        const JobResult& r = results[j];
+        std::printf("%u,%s,%d,%zu,%08x,%.6f,%.2f\n", j, scale_names[job.scale], job.root, job.trajectory, r.hash,
+                    r.peak, r.cost_per_sample);
+        if (!std::isfinite(r.peak))
+            non_finite++;
+        if (r.cost_per_sample > results[worst_job].cost_per_sample)
+            worst_job = j;
+        total_cost += r.cost_per_sample;
+    }
+
+    size_t steals = 0;
+    for (const auto& q : queues)
+        steals += q->steals;
+    double audio_s = double(num_jobs) * static_cast<uint32_t>(seconds * kSampleRate) / kSampleRate;
+    char voice[32];
+    if (batch_voice_mode == VoiceMode::ADDITIVE)
+        std::snprintf(voice, sizeof(voice), "%s x%zu", voice_mode_names[static_cast<size_t>(batch_voice_mode)],
+                      batch_partials);
+    else
+        std::snprintf(voice, sizeof(voice), "%s", voice_mode_names[static_cast<size_t>(batch_voice_mode)]);
+    std::fprintf(stderr,
+                 "%u jobs (%zu scales x %zu roots x %zu trajectories, %s, FM %s at %d%%, shaper %s at %d%%) on %zu threads: "
+                 "%.2f s wall, %.0fx real time, %zu steals\n",
+                 num_jobs, kNumScales, kNumRoots, num_trajectories, voice,
+                 fm_presets[batch_fm_preset].name, batch_fm_depth, shaper_presets[batch_shaper_preset].name,
+                 batch_shaper_drive, num_threads, wall_s,
+                 wall_s > 0.0 ? audio_s / wall_s : 0.0, steals);
+    // The median is the figure to compare between runs; the mean and worst
+    // case also pick up preemption and cache misses
+    std::vector<double> costs(num_jobs);
+    for (uint32_t j = 0; j < num_jobs; j++)
+        costs[j] = results[j].cost_per_sample;
+    std::nth_element(costs.begin(), costs.begin() + num_jobs / 2, costs.end());
+    std::fprintf(stderr, "%s per sample: median %.2f, avg %.2f, worst %.2f (job %zu); %zu jobs with non-finite output\n",
+                 kCostUnit, costs[num_jobs / 2], num_jobs ? total_cost / num_jobs : 0.0,
+                 results[worst_job].cost_per_sample, worst_job, non_finite);
+    return non_finite > 0 ? 1 : 0;
+}
@@ -0,0 +1,98 @@
+// Fast pitch math test
+//
+// Sweeps FastLog2 over every normal positive float and FastExp2 over every
+// float in [-126, 127], comparing each result with the double-precision
+// function. Errors are in cents: 1200 times the log2 difference. Prints the
+// worst case of each with the input that produced it, and exits non-zero if
+// either exceeds the bound stated in the Fast Pitch Math comment.
+//
+// Build (from the repository root):
+//   g++ -std=c++17 -O2 -pthread -DSUBHARMONIC_HOST -I. -I$LIBDAISY/src -I$DAISYSP/Source
+//       host/fast_math_test.cpp oled_fonts.o -L$DAISYSP/build -ldaisysp -o fast_math_test
+//
+// Usage:
+//   fast_math_test [threads]
+
+#include "../subharmonicon.cpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+
+namespace
+{
+constexpr double kExp2BoundCents = 0.005;
+constexpr double kLog2BoundCents = 0.027;
+
+struct Worst
+{
+    double cents = 0.0;
+    float input = 0.0f;
+};
+
+float FromBits(uint32_t bits)
+{
+    float x;
+    std::memcpy(&x, &bits, sizeof(x));
+    return x;
+}
+
+// Both sweeps walk a range of float bit patterns; each thread takes a stride
+template <typename Error>
+Worst Sweep(uint32_t first, uint32_t last, size_t threads, Error error)
+{
+    std::vector<Worst> worst(threads);
+    std::vector<std::thread> pool;
+    for (size_t t = 0; t < threads; t++)
+    {
+        pool.emplace_back([&, t] {
+            Worst& w = worst[t];
+            for (uint64_t bits = first + t; bits <= last; bits += threads)
+            {
+                float x = FromBits(static_cast<uint32_t>(bits));
+                double cents = error(x);
+                if (cents > w.cents)
+                    w = {cents, x};
+            }
+        });
+    }
+    for (std::thread& thread : pool)
+        thread.join();
+    return *std::max_element(worst.begin(), worst.end(),
+                             [](const Worst& a, const Worst& b) { return a.cents < b.cents; });
+}
+
+double Log2ErrorCents(float x)
+{
+    return 1200.0 * std::fabs(static_cast<double>(FastLog2(x)) - std::log2(static_cast<double>(x)));
+}
+
+double Exp2ErrorCents(float x)
+{
+    return 1200.0 * std::fabs(std::log2(static_cast<double>(FastExp2(x))) - static_cast<double>(x));
+}
+} // namespace
+
+int main(int argc, char** argv)
+{
+    size_t threads = (argc > 1) ? static_cast<size_t>(std::atoi(argv[1])) : std::thread::hardware_concurrency();
+    threads = std::max<size_t>(threads, 1);
+
+    // Normal positive floats: 2^-126 up to FLT_MAX
+    Worst log2 = Sweep(0x00800000u, 0x7F7FFFFFu, threads, Log2ErrorCents);
+
+    // [-126, 127] as two bit ranges: the negatives (sign set) down from -0,
+    // and the non-negatives up from +0
+    Worst exp2_neg = Sweep(0x80000000u, 0xC2FC0000u, threads, Exp2ErrorCents);   // -0 .. -126
+    Worst exp2_pos = Sweep(0x00000000u, 0x42FE0000u, threads, Exp2ErrorCents);   // 0 .. 127
+    Worst exp2 = (exp2_neg.cents > exp2_pos.cents) ? exp2_neg : exp2_pos;
+
+    bool ok = log2.cents <= kLog2BoundCents && exp2.cents <= kExp2BoundCents;
+    std::printf("FastLog2: worst %.4f cents at %.9g (bound %.3f)\n", log2.cents, log2.input, kLog2BoundCents);
+    std::printf("FastExp2: worst %.4f cents at %.9g (bound %.3f)\n", exp2.cents, exp2.input, kExp2BoundCents);
+    std::printf("%s\n", ok ? "ok" : "FAILED");
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,148 @@
+// Ladder filter benchmark
+//
+// Times the output ladder filter against the rest of the audio path. The
+// engine renders a held note in oscillator mode with the filter bypassed,
+// at fixed settings, and with the cutoff swept block by block (every block
+// then glides and recomputes its coefficients). The filter is also timed on
+// its own. Each figure is the best of several runs, in nanoseconds per
+// sample and as a share of the block period, the time the callback has
+// before the next DMA half is due. Host shares are far below the module's;
+// the ratio between the engine and the filter is what carries over.
+//
+// Build (from the repository root):
+//   g++ -std=c++17 -O2 -DSUBHARMONIC_HOST -I. -I$LIBDAISY/src -I$DAISYSP/Source
+//       host/filter_bench.cpp oled_fonts.o -L$DAISYSP/build -ldaisysp -o filter_bench
+//
+// Usage:
+//   filter_bench [block_size]
+
+#include "../subharmonicon.cpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <vector>
+
+namespace
+{
+constexpr float kSampleRate = 48000.0f;
+constexpr size_t kBenchSamples = 96000;
+constexpr size_t kBenchRuns = 9;
+
+struct Setting
+{
+    const char* name;
+    int cutoff_step;      // kFilterCutoffSteps bypasses
+    int resonance;        // Percent
+    bool sweep;           // Move the cutoff every block
+};
+
+constexpr Setting kSettings[] = {
+    {"bypassed", kFilterCutoffSteps, 0, false},
+    {"1 kHz", 68, 0, false},
+    {"1 kHz 90%", 68, 90, false},
+    {"sweep 50%", 68, 50, true},
+};
+
+double NowNs()
+{
+    return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Best-of-runs engine time per sample
+double EngineNs(SubharmonicEngine& engine, EngineParams& params, const Setting& setting, size_t block_size)
+{
+    std::vector<float> input(block_size, 0.0f), pitch(block_size, 0.5f), out_l(block_size), out_r(block_size);
+    double best = 1e30;
+    float sink = 0.0f;
+    for (size_t run = 0; run < kBenchRuns; run++)
+    {
+        BuildFilter(params, setting.cutoff_step, setting.resonance / 100.0f);
+        engine.Init(kSampleRate);
+        engine.SetParams(params);
+
+        double start = NowNs();
+        for (size_t done = 0, block = 0; done < kBenchSamples; done += block_size, block++)
+        {
+            if (setting.sweep)
+            {
+                // A slow triangle over five octaves, republished every block
+                int step = 36 + static_cast<int>(block % 120);
+                BuildFilter(params, block % 240 < 120 ? step : 192 - step, setting.resonance / 100.0f);
+                engine.SetParams(params);
+            }
+            engine.ProcessBlock(input.data(), pitch.data(), out_l.data(), out_r.data(), block_size);
+            sink += out_l[0] + out_r[0];
+        }
+        best = std::min(best, (NowNs() - start) / kBenchSamples);
+    }
+    if (!std::isfinite(sink))
+        std::fprintf(stderr, "non-finite output\n");
+    return best;
+}
+
+// Best-of-runs time per sample for the filter alone on a saw-like input
+double LadderNs(const EngineParams& params, size_t block_size)
+{
+    LadderFilter ladder;
+    ladder.Init(kSampleRate);
+    double best = 1e30;
+    float sink = 0.0f;
+    for (size_t run = 0; run < kBenchRuns; run++)
+    {
+        float phase = 0.0f;
+        double start = NowNs();
+        for (size_t done = 0; done < kBenchSamples; done += block_size)
+        {
+            ladder.BeginBlock(params, 0.0f, block_size);
+            for (size_t i = 0; i < block_size; i++)
+            {
+                float l = phase - 0.5f, r = 0.5f - phase;
+                phase = WrapCycle(phase + 0.00271f);
+                ladder.Process(l, r);
+                sink += l + r;
+            }
+        }
+        best = std::min(best, (NowNs() - start) / kBenchSamples);
+    }
+    if (!std::isfinite(sink))
+        std::fprintf(stderr, "non-finite output\n");
+    return best;
+}
+} // namespace
+
+int main(int argc, char** argv)
+{
+    size_t block_size = (argc > 1) ? static_cast<size_t>(std::atoi(argv[1])) : 48;
+    block_size = std::max<size_t>(1, std::min(block_size, kMaxBlockSize));
+    const double period_ns = 1e9 / kSampleRate;   // Budget per sample
+
+    std::unique_ptr<SubharmonicEngine> engine(new SubharmonicEngine);
+    std::unique_ptr<EngineParams> params(new EngineParams);
+    params->voice_mode = VoiceMode::OSCILLATORS;
+    BuildCvTable(default_calibration, params->cv_table);
+    BuildTuningTable(params->tuning, 0, 0, 57);
+    BuildFmMatrix(*params, 0, 0.0f);
+    BuildShaper(*params, 0, 0.0f);
+
+    std::printf("%zu-sample blocks, %.0f ns budget per sample\n", block_size, period_ns);
+    std::printf("%-12s %10s %10s %10s %10s\n", "engine", "ns/sample", "budget", "filter ns", "of engine");
+    double bypassed = 0.0;
+    for (const Setting& setting : kSettings)
+    {
+        double ns = EngineNs(*engine, *params, setting, block_size);
+        if (setting.cutoff_step >= kFilterCutoffSteps)
+            bypassed = ns;
+        double filter = std::max(0.0, ns - bypassed);
+        std::printf("%-12s %10.2f %9.3f%% %10.2f %9.1f%%\n", setting.name, ns, 100.0 * ns / period_ns, filter,
+                    100.0 * filter / ns);
+    }
+
+    BuildFilter(*params, 68, 0.5f);
+    double alone = LadderNs(*params, block_size);
+    std::printf("%-12s %10.2f %9.3f%%\n", "filter alone", alone, 100.0 * alone / period_ns);
+    return 0;
+}
@@ -0,0 +1,604 @@
+// Host stand-in for the parts of libDaisy used by subharmonicon.cpp
+//
+// Compiling the firmware with -DSUBHARMONIC_HOST swaps daisy_patch.h for this
+// header so the DSP and UI code can run on a desktop. Controls and the encoder
+// are driven by the host program, the OLED is a 128x64 framebuffer that can be
+// dumped to PGM files, and the SD card maps onto a host directory. Fonts and
+// DaisySP are the real libraries: add libDaisy/src and DaisySP/Source to the
+// include path and link libDaisy/src/util/oled_fonts.c (built as C) and
+// libdaisysp.
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+
+#include "util/oled_fonts.h"
+
+#define DSY_SDRAM_BSS
+#define DTCM_MEM_SECTION
+#define DMA_BUFFER_MEM_SECTION
+
+namespace daisy
+{
+// Time since the host program started
+inline std::chrono::steady_clock::time_point HostEpoch()
+{
+    static const auto epoch = std::chrono::steady_clock::now();
+    return epoch;
+}
+
+// Simulated clock for repeatable runs. It moves only when the host program
+// advances it, plus a fixed step on every read that stands in for the work
+// done between reads, so budget loops such as the render task's still stop.
+struct SimulatedClock
+{
+    bool on = false;
+    uint32_t us = 0;
+    uint32_t step_us = 0;
+};
+
+inline SimulatedClock& HostClock()
+{
+    static SimulatedClock clock;
+    return clock;
+}
+
+struct System
+{
+    static uint32_t GetNow() { return (HostClock().on ? HostClock().us : RealUs()) / 1000; }
+    static uint32_t GetUs()
+    {
+        SimulatedClock& clock = HostClock();
+        if (!clock.on)
+            return RealUs();
+        uint32_t now = clock.us;
+        clock.us += clock.step_us;
+        return now;
+    }
+    static uint32_t GetTick() { return GetUs(); }
+    static uint32_t GetTickFreq() { return 1000000; }
+    static void Delay(uint32_t ms)
+    {
+        if (HostClock().on)
+            AdvanceUs(ms * 1000);
+        else
+            std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+    }
+
+    // Host-side: switch to the simulated clock, starting at zero
+    static void Simulate(uint32_t step_us)
+    {
+        HostClock() = {true, 0, step_us};
+    }
+    static void AdvanceUs(uint32_t us) { HostClock().us += us; }
+
+  private:
+    static uint32_t RealUs()
+    {
+        return static_cast<uint32_t>(std::chrono::duration_cast<std::chrono::microseconds>(
+                                         std::chrono::steady_clock::now() - HostEpoch())
+                                         .count());
+    }
+};
+
+inline void delay(uint32_t ms)
+{
+    System::Delay(ms);
+}
+
+struct AudioHandle
+{
+    typedef const float* const* InputBuffer;
+    typedef float** OutputBuffer;
+    typedef void (*AudioCallback)(InputBuffer in, OutputBuffer out, size_t size);
+};
+
+// Knob + CV input; the host sets the normalized value directly
+class AnalogControl
+{
+  public:
+    typedef float (*Source)(void* context);
+
+    float Process()
+    {
+        if (source_ != nullptr)
+            value_ = source_(context_);
+        return value_;
+    }
+    float Value() const { return value_; }
+    void SetValue(float value) { value_ = value; }
+
+    // Host-side: a per-sample source, polled on every Process()
+    void SetSource(Source source, void* context = nullptr)
+    {
+        source_ = source;
+        context_ = context;
+    }
+
+  private:
+    float value_ = 0.0f;
+    Source source_ = nullptr;
+    void* context_ = nullptr;
+};
+
+// Encoder with scripted input. Turns and presses queue up on the host side
+// and become visible on the next Debounce(), as on hardware.
+class Encoder
+{
+  public:
+    void Debounce()
+    {
+        increment_ = pending_increment_;
+        pending_increment_ = 0;
+        rising_ = !pressed_ && pending_pressed_;
+        falling_ = pressed_ && !pending_pressed_;
+        if (rising_)
+            press_start_ = System::GetNow();
+        pressed_ = pending_pressed_;
+    }
+
+    int32_t Increment() const { return increment_; }
+    bool RisingEdge() const { return rising_; }
+    bool FallingEdge() const { return falling_; }
+    bool Pressed() const { return pressed_; }
+    float TimeHeldMs() const { return pressed_ ? static_cast<float>(System::GetNow() - press_start_) : 0.0f; }
+
+    // Host-side input
+    void Turn(int32_t detents) { pending_increment_ += detents; }
+    void SetPressed(bool pressed) { pending_pressed_ = pressed; }
+
+  private:
+    int32_t increment_ = 0;
+    int32_t pending_increment_ = 0;
+    bool pressed_ = false;
+    bool pending_pressed_ = false;
+    bool rising_ = false;
+    bool falling_ = false;
+    uint32_t press_start_ = 0;
+};
+
+// Periodic timer. There is no interrupt on the host: tools call the
+// firmware's timer callback themselves.
+class TimerHandle
+{
+  public:
+    struct Config
+    {
+        enum class Peripheral
+        {
+            TIM_2,
+            TIM_3,
+            TIM_4,
+            TIM_5
+        };
+        enum class CounterDir
+        {
+            UP,
+            DOWN
+        };
+
+        Peripheral periph = Peripheral::TIM_2;
+        CounterDir dir = CounterDir::UP;
+        bool enable_irq = false;
+    };
+
+    enum class Result
+    {
+        OK,
+        ERR
+    };
+
+    typedef void (*PeriodElapsedCallback)(void* data);
+
+    Result Init(const Config&) { return Result::OK; }
+    Result Start() { return Result::OK; }
+    Result Stop() { return Result::OK; }
+    Result SetPeriod(uint32_t) { return Result::OK; }
+    Result SetPrescaler(uint32_t) { return Result::OK; }
+    uint32_t GetFreq() const { return 200000000; }
+    void SetCallback(PeriodElapsedCallback, void* = nullptr) {}
+};
+
+class GateIn
+{
+  public:
+    bool Trig()
+    {
+        bool trig = trig_;
+        trig_ = false;
+        return trig;
+    }
+    bool State() const { return state_; }
+
+    // Host-side input
+    void Set(bool high)
+    {
+        trig_ = trig_ || (high && !state_);
+        state_ = high;
+    }
+
+  private:
+    bool state_ = false;
+    bool trig_ = false;
+};
+
+// 128x64 one-bit framebuffer with the OneBitGraphicsDisplay drawing calls
+// used by the firmware. Update() counts the frame and, if a dump directory
+// is set, writes it as a PGM image. Pixels covered by text are tracked
+// separately, so Hash() can stand for a frame without depending on the
+// font's glyph data.
+class HostOledDisplay
+{
+  public:
+    static constexpr uint16_t kWidth = 128;
+    static constexpr uint16_t kHeight = 64;
+
+    uint16_t Width() const { return kWidth; }
+    uint16_t Height() const { return kHeight; }
+
+    void Fill(bool on)
+    {
+        std::memset(pixels_, on ? 1 : 0, sizeof(pixels_));
+        std::memset(text_, 0, sizeof(text_));
+        text_hash_ = 2166136261u;
+    }
+
+    void DrawPixel(uint_fast8_t x, uint_fast8_t y, bool on)
+    {
+        if (x >= kWidth || y >= kHeight)
+            return;
+        pixels_[y][x] = on ? 1 : 0;
+        text_[y][x] = 0;
+    }
+
+    void DrawLine(uint_fast8_t x1, uint_fast8_t y1, uint_fast8_t x2, uint_fast8_t y2, bool on)
+    {
+        int x = x1, y = y1;
+        int dx = std::abs(static_cast<int>(x2) - x), sx = x < x2 ? 1 : -1;
+        int dy = -std::abs(static_cast<int>(y2) - y), sy = y < y2 ? 1 : -1;
+        int err = dx + dy;
+        while (true)
+        {
+            DrawPixel(x, y, on);
+            if (x == x2 && y == y2)
+                break;
+            int e2 = 2 * err;
+            if (e2 >= dy)
+            {
+                err += dy;
+                x += sx;
+            }
+            if (e2 <= dx)
+            {
+                err += dx;
+                y += sy;
+            }
+        }
+    }
+
+    void SetCursor(uint16_t x, uint16_t y)
+    {
+        cursor_x_ = x;
+        cursor_y_ = y;
+    }
+
+    char WriteChar(char ch, FontDef font, bool on)
+    {
+        if (Width() <= (cursor_x_ + font.FontWidth) || Height() <= (cursor_y_ + font.FontHeight))
+            return 0;
+        for (uint32_t i = 0; i < font.FontHeight; i++)
+        {
+            uint32_t b = font.data[(ch - 32) * font.FontHeight + i];
+            for (uint32_t j = 0; j < font.FontWidth; j++)
+            {
+                DrawPixel(cursor_x_ + j, cursor_y_ + i, ((b << j) & 0x8000) ? on : !on);
+                text_[cursor_y_ + i][cursor_x_ + j] = 1;
+            }
+        }
+        const uint32_t call[] = {static_cast<uint8_t>(ch), cursor_x_, cursor_y_, font.FontWidth, font.FontHeight,
+                                 on ? 1u : 0u};
+        for (uint32_t v : call)
+            text_hash_ = (text_hash_ ^ v) * 16777619u;
+        cursor_x_ += font.FontWidth;
+        return ch;
+    }
+
+    char WriteString(const char* str, FontDef font, bool on)
+    {
+        while (*str)
+        {
+            if (WriteChar(*str, font, on) != *str)
+                return *str;
+            str++;
+        }
+        return *str;
+    }
+
+    void Update()
+    {
+        frame_count_++;
+        if (dump_dir_.empty())
+            return;
+
+        // Formatted in place so a frame flush never allocates
+        char path[512];
+        std::snprintf(path, sizeof(path), "%s/%s%u.pgm", dump_dir_.c_str(), dump_prefix_.c_str(),
+                      static_cast<unsigned>(++dump_index_));
+        WritePgm(path);
+    }
+
+    // Host-side inspection
+    void SetDumpDirectory(const std::string& dir, const std::string& prefix = "frame_")
+    {
+        dump_dir_ = dir;
+        dump_prefix_ = prefix;
+        dump_index_ = 0;
+    }
+    bool Pixel(size_t x, size_t y) const { return pixels_[y][x] != 0; }
+    uint32_t FrameCount() const { return frame_count_; }
+
+    // FNV-1a over the framebuffer, for comparing renders between runs.
+    // Text pixels are left out and each character drawn (code, position,
+    // font size, colour) goes in instead, so the hash doesn't change with
+    // the font's glyph data.
+    uint32_t Hash() const
+    {
+        uint32_t h = 2166136261u;
+        for (size_t y = 0; y < kHeight; y++)
+            for (size_t x = 0; x < kWidth; x++)
+                h = (h ^ (text_[y][x] ? 2u : pixels_[y][x])) * 16777619u;
+        return (h ^ text_hash_) * 16777619u;
+    }
+
+    bool WritePgm(const char* path) const
+    {
+        FILE* f = std::fopen(path, "wb");
+        if (f == nullptr)
+            return false;
+        std::fprintf(f, "P5\n%d %d\n255\n", kWidth, kHeight);
+        for (size_t y = 0; y < kHeight; y++)
+            for (size_t x = 0; x < kWidth; x++)
+                std::fputc(pixels_[y][x] ? 255 : 0, f);
+        std::fclose(f);
+        return true;
+    }
+
+  private:
+    uint8_t pixels_[kHeight][kWidth] = {{0}};
+    uint8_t text_[kHeight][kWidth] = {{0}};   // Covered by a character cell
+    uint32_t text_hash_ = 2166136261u;        // Characters drawn since the last Fill
+    uint16_t cursor_x_ = 0;
+    uint16_t cursor_y_ = 0;
+    uint32_t frame_count_ = 0;
+    uint32_t dump_index_ = 0;
+    std::string dump_dir_;
+    std::string dump_prefix_;
+};
+
+struct QSPIHandle
+{
+};
+
+struct DaisySeed
+{
+    QSPIHandle qspi;
+
+    static void StartLog(bool = false) {}
+
+    template <typename... Args>
+    static void Print(const char* format, Args... args)
+    {
+        if (!LogMuted())
+            std::printf(format, args...);
+    }
+
+    template <typename... Args>
+    static void PrintLine(const char* format, Args... args)
+    {
+        if (LogMuted())
+            return;
+        std::printf(format, args...);
+        std::printf("\n");
+    }
+
+    // Host-side: drop serial output, for tools whose stdout is a report
+    static bool& LogMuted()
+    {
+        static bool muted = false;
+        return muted;
+    }
+};
+
+class DaisyPatch
+{
+  public:
+    enum Ctrl
+    {
+        CTRL_1,
+        CTRL_2,
+        CTRL_3,
+        CTRL_4,
+        CTRL_LAST
+    };
+
+    enum GateInput
+    {
+        GATE_IN_1,
+        GATE_IN_2,
+        GATE_IN_LAST
+    };
+
+    void Init(bool = false) {}
+    float AudioSampleRate() const { return sample_rate_; }
+    size_t AudioBlockSize() const { return block_size_; }
+    void SetAudioBlockSize(size_t size) { block_size_ = size; }
+    void StartAdc() {}
+    void StartAudio(AudioHandle::AudioCallback cb) { callback_ = cb; }
+    void ProcessAnalogControls() {}
+    void ProcessDigitalControls() { encoder.Debounce(); }
+    void ProcessAllControls()
+    {
+        ProcessAnalogControls();
+        ProcessDigitalControls();
+    }
+
+    // Host-side: the callback registered by StartAudio, if any
+    AudioHandle::AudioCallback Callback() const { return callback_; }
+
+    AnalogControl controls[CTRL_LAST];
+    Encoder encoder;
+    GateIn gate_input[GATE_IN_LAST];
+    HostOledDisplay display;
+    DaisySeed seed;
+
+  private:
+    float sample_rate_ = 48000.0f;
+    size_t block_size_ = 48;
+    AudioHandle::AudioCallback callback_ = nullptr;
+};
+
+// Settings live in memory for the lifetime of the host program
+template <typename SettingsType>
+class PersistentStorage
+{
+  public:
+    enum class State
+    {
+        UNKNOWN,
+        FACTORY,
+        USER
+    };
+
+    explicit PersistentStorage(QSPIHandle&) {}
+
+    void Init(const SettingsType& defaults, uint32_t = 0)
+    {
+        defaults_ = defaults;
+        settings_ = defaults;
+        state_ = State::FACTORY;
+    }
+    State GetState() const { return state_; }
+    SettingsType& GetSettings() { return settings_; }
+    void Save() { state_ = State::USER; }
+    void RestoreDefaults()
+    {
+        settings_ = defaults_;
+        state_ = State::FACTORY;
+    }
+
+  private:
+    SettingsType defaults_;
+    SettingsType settings_;
+    State state_ = State::UNKNOWN;
+};
+
+struct SdmmcHandler
+{
+    enum class Result
+    {
+        OK,
+        ERROR
+    };
+    struct Config
+    {
+        void Defaults() {}
+    };
+    Result Init(const Config&) { return Result::OK; }
+};
+
+} // namespace daisy
+
+// FatFs on the host: paths resolve against $SUBHARMONIC_SD_ROOT (default "sd")
+typedef unsigned int UINT;
+typedef int FRESULT;
+enum
+{
+    FR_OK = 0,
+    FR_DISK_ERR = 1,
+    FR_NO_FILE = 4
+};
+enum
+{
+    FA_READ = 0x01,
+    FA_WRITE = 0x02,
+    FA_CREATE_ALWAYS = 0x08,
+    FA_OPEN_APPEND = 0x30
+};
+
+struct FATFS
+{
+};
+
+struct FIL
+{
+    FILE* fp = nullptr;
+};
+
+inline std::string HostSdPath(const char* path)
+{
+    const char* root = std::getenv("SUBHARMONIC_SD_ROOT");
+    return std::string(root != nullptr ? root : "sd") + "/" + path;
+}
+
+inline FRESULT f_mount(FATFS*, const char*, unsigned char)
+{
+    return FR_OK;
+}
+
+inline FRESULT f_open(FIL* file, const char* path, unsigned char mode)
+{
+    const char* fmode = (mode & FA_WRITE) ? (((mode & FA_OPEN_APPEND) == FA_OPEN_APPEND) ? "ab" : "wb") : "rb";
+    file->fp = std::fopen(HostSdPath(path).c_str(), fmode);
+    return file->fp != nullptr ? FR_OK : FR_NO_FILE;
+}
+
+inline FRESULT f_close(FIL* file)
+{
+    if (file->fp != nullptr)
+        std::fclose(file->fp);
+    file->fp = nullptr;
+    return FR_OK;
+}
+
+inline FRESULT f_read(FIL* file, void* buf, UINT len, UINT* read)
+{
+    *read = static_cast<UINT>(std::fread(buf, 1, len, file->fp));
+    return std::ferror(file->fp) ? FR_DISK_ERR : FR_OK;
+}
+
+inline FRESULT f_write(FIL* file, const void* buf, UINT len, UINT* written)
+{
+    *written = static_cast<UINT>(std::fwrite(buf, 1, len, file->fp));
+    return (*written == len) ? FR_OK : FR_DISK_ERR;
+}
+
+namespace daisy
+{
+struct FatFSInterface
+{
+    struct Config
+    {
+        enum Media : uint8_t
+        {
+            MEDIA_SD = 0x01,
+            MEDIA_USB = 0x02
+        };
+    };
+    enum class Result
+    {
+        OK,
+        ERR_GENERIC
+    };
+    Result Init(const uint8_t) { return Result::OK; }
+    FATFS& GetSDFileSystem() { return fs_; }
+
+  private:
+    FATFS fs_;
+};
+} // namespace daisy
@@ -0,0 +1,156 @@
+// Host OLED emulator
+//
+// Runs the firmware's audio callback and main-loop scheduler against the host
+// Patch stand-in and renders every display view and menu page. The scheduler
+// runs on the simulated host clock, so the render task slices each frame over
+// several passes as it does on hardware, and every run draws the same frames.
+// Prints per-view render timing and a framebuffer hash for each view, and
+// optionally dumps every frame as a PGM image for inspection or diffing.
+//
+// At the default frame count each hash is checked against the view's golden
+// hash, and the run exits non-zero on any mismatch. A change that is meant to
+// alter a view updates its golden hash in the same commit. The hash takes
+// text as the characters drawn rather than their glyph pixels, so the
+// goldens hold with any build of oled_fonts.c.
+//
+// Built with -DSUBHARMONIC_NO_HEAP (and linked with
+// -Wl,--wrap=malloc,--wrap=calloc,--wrap=realloc) it also counts heap
+// allocations while the views run, and exits non-zero if there were any.
+//
+// Build (from the repository root):
+//   gcc -c -O2 -I$LIBDAISY/src $LIBDAISY/src/util/oled_fonts.c -o oled_fonts.o
+//   g++ -std=c++17 -O2 -DSUBHARMONIC_HOST -I. -I$LIBDAISY/src -I$DAISYSP/Source
+//       host/oled_emulator.cpp oled_fonts.o -L$DAISYSP/build -ldaisysp -o oled_emulator
+//
+// Usage:
+//   oled_emulator [frames_per_view] [dump_dir]
+
+#include "../subharmonicon.cpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+namespace
+{
+constexpr size_t kBlockSize = 48;
+constexpr size_t kBlocksPerFrame = 16; // Audio rendered between frames
+constexpr uint32_t kBlockUs = 1000;    // 48 samples at 48 kHz
+constexpr uint32_t kClockStepUs = 100; // Simulated time per clock read; a frame takes several render slices
+constexpr size_t kGoldenFrames = 32;   // Frames per view the golden hashes are taken at
+
+struct View
+{
+    const char* name;
+    bool menu;
+    DisplayMode mode;
+    MenuState page;
+    uint32_t golden;   // Framebuffer hash after kGoldenFrames frames
+};
+
+const View views[] = {
+    {"waveform", false, DisplayMode::WAVEFORM, MenuState::SCALE_SELECTION, 0x20c12030},
+    {"xy", false, DisplayMode::XY, MenuState::SCALE_SELECTION, 0x73c7fa48},
+    {"phosphor", false, DisplayMode::PHOSPHOR, MenuState::SCALE_SELECTION, 0x519f8287},
+    {"spectrum", false, DisplayMode::SPECTRUM, MenuState::SCALE_SELECTION, 0x4bb06329},
+    {"tuner", false, DisplayMode::TUNER, MenuState::SCALE_SELECTION, 0x7676e11f},
+    {"menu_scale", true, DisplayMode::WAVEFORM, MenuState::SCALE_SELECTION, 0x2eb77749},
+    {"menu_root", true, DisplayMode::WAVEFORM, MenuState::ROOT_NOTE_SELECTION, 0xd3dd5ccf},
+    {"menu_tuning", true, DisplayMode::WAVEFORM, MenuState::TUNING_SELECTION, 0x907b611a},
+    {"menu_mode", true, DisplayMode::WAVEFORM, MenuState::MODE_SELECTION, 0xd88e48fa},
+    {"menu_calibration", true, DisplayMode::WAVEFORM, MenuState::CALIBRATION, 0x86cf75d5},
+    {"menu_recorder", true, DisplayMode::WAVEFORM, MenuState::RECORDER, 0x43ea1ed7},
+    {"menu_trace", true, DisplayMode::WAVEFORM, MenuState::TRACE, 0xa8bdb05a},
+    {"menu_fm", true, DisplayMode::WAVEFORM, MenuState::FM_ROUTING, 0x68db2bb5},
+    {"menu_fm_depth", true, DisplayMode::WAVEFORM, MenuState::FM_DEPTH, 0x604b859a},
+    {"menu_shaper", true, DisplayMode::WAVEFORM, MenuState::SHAPER, 0x83b763b3},
+    {"menu_shaper_drive", true, DisplayMode::WAVEFORM, MenuState::SHAPER_DRIVE, 0x72fff814},
+    {"menu_cutoff", true, DisplayMode::WAVEFORM, MenuState::FILTER_CUTOFF, 0x3d21eaca},
+    {"menu_resonance", true, DisplayMode::WAVEFORM, MenuState::FILTER_RESONANCE, 0x2c629d5b},
+    {"menu_envelope", true, DisplayMode::WAVEFORM, MenuState::ENVELOPE, 0x6da4d982},
+    {"menu_env_time", true, DisplayMode::WAVEFORM, MenuState::ENV_TIME, 0xa8148f6a},
+    {"menu_env_cutoff", true, DisplayMode::WAVEFORM, MenuState::ENV_CUTOFF, 0xd08145c1},
+    {"menu_seq_rate", true, DisplayMode::WAVEFORM, MenuState::SEQ_RATE, 0x7aeb0b4c},
+    {"menu_mod", true, DisplayMode::WAVEFORM, MenuState::MOD_ROUTING, 0x995ef373},
+    {"menu_mod_depth", true, DisplayMode::WAVEFORM, MenuState::MOD_DEPTH, 0x6745212b},
+    {"menu_lfo_rate", true, DisplayMode::WAVEFORM, MenuState::LFO_RATE, 0xf29ed749},
+    {"menu_partials", true, DisplayMode::WAVEFORM, MenuState::PARTIALS, 0x61b05b92},
+};
+
+float input_l[kBlockSize];
+float input_r[kBlockSize];
+float output_l[kBlockSize];
+float output_r[kBlockSize];
+
+void RunAudio(size_t blocks)
+{
+    const float* in[2] = {input_l, input_r};
+    float* out[2] = {output_l, output_r};
+    for (size_t b = 0; b < blocks; b++)
+    {
+        AudioCallback(in, out, kBlockSize);
+        System::AdvanceUs(kBlockUs);
+    }
+}
+} // namespace
+
+int main(int argc, char** argv)
+{
+    size_t frames = (argc > 1) ? static_cast<size_t>(std::atoi(argv[1])) : kGoldenFrames;
+    bool check = frames == kGoldenFrames;
+    std::string dump_dir = (argc > 2) ? argv[2] : "";
+
+    System::Simulate(kClockStepUs);
+    patch.seed.LogMuted() = true;
+    InitModule();
+    patch.controls[CTRL_PITCH].SetValue(0.45f);
+    size_t boot_allocations = heap_allocations;
+    size_t run_allocations = 0;
+    size_t mismatches = 0;
+
+    std::printf("%-18s %8s %8s %8s  %s\n", "view", "min_us", "avg_us", "max_us", "hash");
+    for (const View& view : views)
+    {
+        menu_active = view.menu;
+        display_mode = view.mode;
+        menu_state = view.page;
+        if (!dump_dir.empty())
+            patch.display.SetDumpDirectory(dump_dir, std::string(view.name) + "_");
+
+        size_t allocations_before = heap_allocations;
+        double min_us = 1e9, max_us = 0.0, total_us = 0.0;
+        for (size_t f = 0; f < frames; f++)
+        {
+            RunAudio(kBlocksPerFrame);
+
+            auto start = std::chrono::steady_clock::now();
+            MainLoopPass();
+            double us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+
+            min_us = std::min(min_us, us);
+            max_us = std::max(max_us, us);
+            total_us += us;
+        }
+
+        run_allocations += heap_allocations - allocations_before;
+
+        uint32_t hash = patch.display.Hash();
+        bool mismatch = check && hash != view.golden;
+        mismatches += mismatch ? 1 : 0;
+        std::printf("%-18s %8.1f %8.1f %8.1f  %08x%s\n", view.name, min_us, total_us / frames, max_us, hash,
+                    mismatch ? "  MISMATCH" : "");
+    }
+    if (mismatches > 0)
+        std::printf("%zu view(s) differ from their golden hash\n", mismatches);
+
+#if defined(SUBHARMONIC_NO_HEAP)
+    std::printf("heap allocations: %zu at boot, %zu while running\n", boot_allocations, run_allocations);
+    return (run_allocations == 0 && mismatches == 0) ? 0 : 1;
+#else
+    (void)boot_allocations;
+    (void)run_allocations;
+    return (mismatches == 0) ? 0 : 1;
+#endif
+}
@@ -0,0 +1,172 @@
+// Oversampling benchmark
+//
+// Measures what the shaper's oversampling buys and costs. Each curve runs at
+// 1x, 2x and 4x on test sines placed exactly on FFT bins; the output power
+// that lands on the tone's own harmonics (below Nyquist) is signal, and
+// everything else apart from DC is alias. The table lists the alias level
+// relative to the signal at each test frequency, and the Waveshaper::Process
+// cost per stereo sample, best of several runs.
+//
+// Build (from the repository root):
+//   g++ -std=c++17 -O2 -DSUBHARMONIC_HOST -I. -I$LIBDAISY/src -I$DAISYSP/Source
+//       host/oversampling_bench.cpp oled_fonts.o -L$DAISYSP/build -ldaisysp -o oversampling_bench
+//
+// Usage:
+//   oversampling_bench [drive_percent]
+
+#include "../subharmonicon.cpp"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <complex>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+namespace
+{
+constexpr double kSampleRate = 48000.0;
+constexpr size_t kFftLength = 16384;
+constexpr size_t kSettle = 4096;                 // Samples run before the capture
+constexpr size_t kCostSamples = 48000;
+constexpr size_t kCostRuns = 9;
+constexpr size_t kTestBins[] = {343, 1365, 3413}; // About 1, 4 and 10 kHz; odd, so no alias lands on a harmonic
+constexpr ShaperMode kModes[] = {ShaperMode::FOLD, ShaperMode::TANH, ShaperMode::ASYM};
+constexpr const char* kModeNames[] = {"fold", "tanh", "asym"};
+constexpr uint8_t kFactors[] = {1, 2, 4};
+
+#if defined(__x86_64__) || defined(__i386__)
+constexpr const char* kCostUnit = "cycles";
+uint64_t ReadCost() { return __rdtsc(); }
+#else
+constexpr const char* kCostUnit = "ns";
+uint64_t ReadCost()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+#endif
+
+// In-place radix-2 FFT
+void Fft(std::vector<std::complex<double>>& x)
+{
+    const size_t n = x.size();
+    for (size_t i = 1, j = 0; i < n; i++)
+    {
+        size_t bit = n >> 1;
+        for (; j & bit; bit >>= 1)
+            j ^= bit;
+        j ^= bit;
+        if (i < j)
+            std::swap(x[i], x[j]);
+    }
+    for (size_t len = 2; len <= n; len <<= 1)
+    {
+        std::complex<double> w = std::polar(1.0, -2.0 * M_PI / static_cast<double>(len));
+        for (size_t i = 0; i < n; i += len)
+        {
+            std::complex<double> wk = 1.0;
+            for (size_t k = 0; k < len / 2; k++, wk *= w)
+            {
+                std::complex<double> a = x[i + k], b = x[i + k + len / 2] * wk;
+                x[i + k] = a + b;
+                x[i + k + len / 2] = a - b;
+            }
+        }
+    }
+}
+
+// The presets only pair curves with 2x and 4x; 1x is the baseline here
+EngineParams MakeParams(ShaperMode mode, uint8_t factor, float drive)
+{
+    EngineParams p;
+    BuildShaper(p, 0, drive);
+    p.shaper_mode = mode;
+    p.shaper_factor = factor;
+    return p;
+}
+
+// Alias power relative to harmonic power, in dB, for a full-scale sine on bin
+double AliasDb(const EngineParams& p, size_t bin)
+{
+    Waveshaper shaper;
+    shaper.Init();
+    std::vector<std::complex<double>> spectrum(kFftLength);
+    for (size_t n = 0; n < kSettle + kFftLength; n++)
+    {
+        float l = 0.5f * static_cast<float>(std::sin(2.0 * M_PI * bin * (n % kFftLength) / kFftLength));
+        float r = l;
+        shaper.Process(p, l, r);
+        if (n >= kSettle)
+            spectrum[n - kSettle] = l;
+    }
+    Fft(spectrum);
+
+    double harmonic = 0.0, alias = 0.0;
+    for (size_t k = 1; k <= kFftLength / 2; k++)
+    {
+        double power = std::norm(spectrum[k]);
+        if (k % bin == 0)
+            harmonic += power;
+        else
+            alias += power;
+    }
+    return 10.0 * std::log10(std::max(alias, 1e-30) / std::max(harmonic, 1e-30));
+}
+
+// Best-of-runs cost per stereo sample on a 1 kHz sine
+double CostPerSample(const EngineParams& p)
+{
+    Waveshaper shaper;
+    shaper.Init();
+    double best = 1e30;
+    float phase = 0.0f;
+    float sink = 0.0f;
+    for (size_t run = 0; run < kCostRuns; run++)
+    {
+        uint64_t start = ReadCost();
+        for (size_t n = 0; n < kCostSamples; n++)
+        {
+            float l = 0.5f * SinCycle(phase);
+            float r = -l;
+            phase = WrapCycle(phase + 1000.0f / static_cast<float>(kSampleRate));
+            shaper.Process(p, l, r);
+            sink += l + r;
+        }
+        best = std::min(best, static_cast<double>(ReadCost() - start) / kCostSamples);
+    }
+    if (!std::isfinite(sink))
+        std::fprintf(stderr, "non-finite output\n");
+    return best;
+}
+} // namespace
+
+int main(int argc, char** argv)
+{
+    int drive_percent = (argc > 1) ? std::max(0, std::min(kShaperMaxDrive, std::atoi(argv[1]))) : 50;
+    float drive = static_cast<float>(drive_percent) / kShaperMaxDrive;
+
+    std::printf("drive %d%%, alias/harmonic power in dB, %s per stereo sample\n", drive_percent, kCostUnit);
+    std::printf("%-6s %6s", "curve", "factor");
+    for (size_t bin : kTestBins)
+        std::printf(" %8.0fHz", bin * kSampleRate / kFftLength);
+    std::printf(" %10s\n", kCostUnit);
+
+    for (size_t m = 0; m < sizeof(kModes) / sizeof(kModes[0]); m++)
+    {
+        for (uint8_t factor : kFactors)
+        {
+            EngineParams p = MakeParams(kModes[m], factor, drive);
+            std::printf("%-6s %5ux", kModeNames[m], factor);
+            for (size_t bin : kTestBins)
+                std::printf(" %10.1f", AliasDb(p, bin));
+            std::printf(" %10.1f\n", CostPerSample(p));
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,279 @@
+// Real-time host simulator
+//
+// Reproduces the firmware's two contexts on a desktop: AudioCallback runs on
+// a SCHED_FIFO thread woken at the configured block period, and the main
+// loop (encoder timer tick plus the task scheduler, which handles the
+// encoder and draws the display) runs on a normal-priority UI thread against
+// the host Patch. A script can drive the encoder, switch views and add busy
+// work to the UI thread. At the end it reports wake-up jitter, callback
+// time, deadline misses, and contention: audio-thread preemptions and tuner
+// snapshot retries on the UI side.
+//
+// SCHED_FIFO needs CAP_SYS_NICE (or root); without it the audio thread runs
+// at normal priority and the report says so.
+//
+// Build (from the repository root):
+//   g++ -std=c++17 -O2 -pthread -DSUBHARMONIC_HOST -I. -I$LIBDAISY/src -I$DAISYSP/Source
+//       host/realtime_sim.cpp oled_fonts.o -L$DAISYSP/build -ldaisysp -o realtime_sim
+//
+// Usage:
+//   realtime_sim [seconds] [script]
+//
+// Script lines are "<ms> <action> [arg]", in time order; # starts a comment:
+//   500 turn 3       encoder detents (negative turns left)
+//   900 press        press and release the encoder
+//   1000 view 2      jump to a display view (menu closed)
+//   1200 load 800    busy-wait this many us on every UI pass
+//   1500 pitch 0.7   set the pitch CV (0..1); default is a slow sweep
+//   1600 gate 1      set gate input 1 high (1) or low (0)
+//   1700 cv3 0.25    set CV 2, 3 or 4 (0..1, 0.5 is no modulation)
+
+#include "../subharmonicon.cpp"
+
+#include <pthread.h>
+#include <sched.h>
+#include <sys/resource.h>
+#include <time.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+namespace
+{
+constexpr int kAudioPriority = 80;
+constexpr uint32_t kPressMs = 30;   // Scripted presses are held this long
+
+struct ScriptStep
+{
+    uint32_t ms;
+    char action[16];
+    float arg;
+};
+
+std::vector<ScriptStep> script;
+std::atomic<bool> running{true};
+std::atomic<uint32_t> ui_load_us{0};
+std::atomic<float> pitch_override{-1.0f};
+
+// Audio-thread results
+std::vector<double> wake_jitter_us;
+std::vector<double> callback_us;
+size_t deadline_misses = 0;
+long audio_preemptions = 0;
+bool audio_realtime = false;
+
+// UI-thread results
+size_t ui_passes = 0;
+double ui_worst_pass_us = 0.0;
+
+int64_t NowNs()
+{
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return int64_t(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+void SleepUntil(int64_t ns)
+{
+    timespec ts;
+    ts.tv_sec = ns / 1000000000;
+    ts.tv_nsec = ns % 1000000000;
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, nullptr) == EINTR)
+    {
+    }
+}
+
+bool LoadScript(const char* path)
+{
+    FILE* f = std::fopen(path, "r");
+    if (f == nullptr)
+        return false;
+    char line[128];
+    while (std::fgets(line, sizeof(line), f) != nullptr)
+    {
+        ScriptStep step = {0, "", 0.0f};
+        if (line[0] == '#' || std::sscanf(line, "%u %15s %f", &step.ms, step.action, &step.arg) < 2)
+            continue;
+        script.push_back(step);
+    }
+    std::fclose(f);
+    std::stable_sort(script.begin(), script.end(),
+                     [](const ScriptStep& a, const ScriptStep& b) { return a.ms < b.ms; });
+    return true;
+}
+
+float SweepPitch(void*)
+{
+    static uint32_t n = 0;
+    float forced = pitch_override.load(std::memory_order_relaxed);
+    if (forced >= 0.0f)
+        return forced;
+    return 0.45f + 0.2f * std::sin(static_cast<float>(n++) * 1e-5f);
+}
+
+void AudioThread(int64_t start_ns, int64_t period_ns, size_t block_size)
+{
+    sched_param param = {};
+    param.sched_priority = kAudioPriority;
+    audio_realtime = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param) == 0;
+
+    std::vector<float> in_l(block_size, 0.0f), in_r(block_size, 0.0f);
+    std::vector<float> out_l(block_size), out_r(block_size);
+    const float* in[2] = {in_l.data(), in_r.data()};
+    float* out[2] = {out_l.data(), out_r.data()};
+
+    rusage before;
+    getrusage(RUSAGE_THREAD, &before);
+
+    for (int64_t deadline = start_ns + period_ns; running.load(std::memory_order_relaxed); deadline += period_ns)
+    {
+        SleepUntil(deadline);
+        int64_t woke = NowNs();
+        AudioCallback(in, out, block_size);
+        int64_t done = NowNs();
+
+        wake_jitter_us.push_back((woke - deadline) / 1000.0);
+        callback_us.push_back((done - woke) / 1000.0);
+
+        // The next DMA half would already be playing
+        if (done > deadline + period_ns)
+        {
+            deadline_misses++;
+            deadline = done - (done - deadline) % period_ns;
+        }
+    }
+
+    rusage after;
+    getrusage(RUSAGE_THREAD, &after);
+    audio_preemptions = after.ru_nivcsw - before.ru_nivcsw;
+}
+
+void UiThread(int64_t start_ns)
+{
+    size_t next_step = 0;
+    uint32_t release_ms = 0;
+    int64_t next_tick = start_ns;
+    const int64_t tick_ns = 1000000000 / kEncoderTickHz;
+
+    while (running.load(std::memory_order_relaxed))
+    {
+        int64_t now = NowNs();
+        uint32_t ms = static_cast<uint32_t>((now - start_ns) / 1000000);
+
+        // Scripted input
+        for (; next_step < script.size() && script[next_step].ms <= ms; next_step++)
+        {
+            const ScriptStep& s = script[next_step];
+            if (std::strcmp(s.action, "turn") == 0)
+                patch.encoder.Turn(static_cast<int32_t>(s.arg));
+            else if (std::strcmp(s.action, "press") == 0)
+            {
+                patch.encoder.SetPressed(true);
+                release_ms = ms + kPressMs;
+            }
+            else if (std::strcmp(s.action, "view") == 0)
+            {
+                menu_active = false;
+                display_mode = static_cast<DisplayMode>(static_cast<size_t>(s.arg) % kNumDisplayModes);
+            }
+            else if (std::strcmp(s.action, "load") == 0)
+                ui_load_us.store(static_cast<uint32_t>(s.arg));
+            else if (std::strcmp(s.action, "pitch") == 0)
+                pitch_override.store(s.arg);
+            else if (std::strcmp(s.action, "gate") == 0)
+                patch.gate_input[DaisyPatch::GATE_IN_1].Set(s.arg != 0.0f);
+            else if (std::strcmp(s.action, "cv2") == 0)
+                patch.controls[CTRL_CV2].SetValue(s.arg);
+            else if (std::strcmp(s.action, "cv3") == 0)
+                patch.controls[CTRL_CV3].SetValue(s.arg);
+            else if (std::strcmp(s.action, "cv4") == 0)
+                patch.controls[CTRL_CV4].SetValue(s.arg);
+        }
+
+        // Encoder timer interrupt stand-in
+        if (now >= next_tick)
+        {
+            EncoderTimerCallback(nullptr);
+            next_tick += tick_ns;
+            if (ms >= release_ms)
+                patch.encoder.SetPressed(false);
+        }
+
+        int64_t pass_start = NowNs();
+        RunScheduler();
+        for (int64_t spin_end = NowNs() + int64_t(ui_load_us.load()) * 1000; NowNs() < spin_end;)
+        {
+        }
+        ui_worst_pass_us = std::max(ui_worst_pass_us, (NowNs() - pass_start) / 1000.0);
+        ui_passes++;
+    }
+}
+
+double Percentile(std::vector<double> v, double p)
+{
+    if (v.empty())
+        return 0.0;
+    std::sort(v.begin(), v.end());
+    return v[std::min(v.size() - 1, static_cast<size_t>(p * v.size()))];
+}
+
+void Report(const char* name, const std::vector<double>& v)
+{
+    double sum = 0.0;
+    for (double x : v)
+        sum += x;
+    std::printf("%-14s %9.2f %9.2f %9.2f %9.2f %9.2f\n", name, Percentile(v, 0.0), v.empty() ? 0.0 : sum / v.size(),
+                Percentile(v, 0.99), Percentile(v, 0.999), v.empty() ? 0.0 : *std::max_element(v.begin(), v.end()));
+}
+} // namespace
+
+int main(int argc, char** argv)
+{
+    double seconds = (argc > 1) ? std::atof(argv[1]) : 10.0;
+    if (argc > 2 && !LoadScript(argv[2]))
+    {
+        std::perror(argv[2]);
+        return 1;
+    }
+
+    InitModule();
+    patch.controls[CTRL_PITCH].SetSource(SweepPitch);
+
+    size_t block_size = patch.AudioBlockSize();
+    int64_t period_ns = static_cast<int64_t>(1e9 * block_size / patch.AudioSampleRate());
+    wake_jitter_us.reserve(static_cast<size_t>(seconds * 1e9 / period_ns) + 16);
+    callback_us.reserve(wake_jitter_us.capacity());
+
+    int64_t start_ns = NowNs();
+    std::thread audio(AudioThread, start_ns, period_ns, block_size);
+    std::thread ui(UiThread, start_ns);
+
+    SleepUntil(start_ns + static_cast<int64_t>(seconds * 1e9));
+    running.store(false);
+    audio.join();
+    ui.join();
+
+    std::printf("%zu blocks of %zu samples every %.1f us; audio thread %s\n", callback_us.size(), block_size,
+                period_ns / 1000.0, audio_realtime ? "SCHED_FIFO" : "normal priority (SCHED_FIFO refused)");
+    std::printf("%-14s %9s %9s %9s %9s %9s\n", "us", "min", "avg", "p99", "p99.9", "max");
+    Report("wake jitter", wake_jitter_us);
+    Report("callback", callback_us);
+    std::printf("deadline misses %zu, audio overruns %u\n", deadline_misses,
+                audio_overruns.load(std::memory_order_relaxed));
+    std::printf("contention: %ld audio-thread preemptions, %u tuner snapshot retries\n", audio_preemptions,
+                engine.tuner_snapshot.read_retries);
+    std::printf("ui: %zu passes, worst %.1f us, input-to-screen worst %u us\n", ui_passes, ui_worst_pass_us,
+                ui_latency_worst_us);
+    for (const Task& task : tasks)
+    {
+        std::printf("  %-9s worst %6u us, %u overruns\n", task.name, task.worst_us, task.overruns);
+    }
+    return 0;
+}
@@ -0,0 +1,304 @@
+// Host control-session replay
+//
+// Loads a session recorded on the module (session.shr from the SD card),
+// restores the UI state it started from, and feeds its pitch CV, CV 2-4, gate
+// and encoder input through AudioCallback and the main-loop scheduler block
+// by block. The scheduler runs on the simulated host clock, advanced by one
+// block period per block, so the render task slices frames as on hardware. Runs are
+// deterministic: the output hash only changes when the audio does, so it can
+// be compared across builds when bisecting, and the block timings show where
+// the time goes. Sessions from older firmware load too; settings their
+// version didn't record start at the module's defaults.
+//
+// Build (from the repository root):
+//   gcc -c -O2 -I$LIBDAISY/src $LIBDAISY/src/util/oled_fonts.c -o oled_fonts.o
+//   g++ -std=c++17 -O2 -DSUBHARMONIC_HOST -I. -I$LIBDAISY/src -I$DAISYSP/Source
+//       host/replay.cpp oled_fonts.o -L$DAISYSP/build -ldaisysp -o replay
+//
+// Usage:
+//   replay session.shr
+
+#include "../subharmonicon.cpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+namespace
+{
+constexpr uint32_t kClockStepUs = 10;   // Simulated time per clock read
+
+struct Session
+{
+    SessionHeader header;
+    std::vector<ControlRecord> pitch;
+    std::vector<ControlRecord> gate;
+    std::vector<ControlRecord> cv;
+    std::vector<ControlRecord> encoder;
+};
+
+// Per-sample pitch source for the host AnalogControl
+struct PitchCursor
+{
+    const std::vector<ControlRecord>* records = nullptr;
+    size_t next = 0;
+    uint32_t sample = 0;
+    float value = 0.0f;
+};
+
+PitchCursor pitch_cursor;
+
+float NextPitch(void* context)
+{
+    PitchCursor& cursor = *static_cast<PitchCursor*>(context);
+    const std::vector<ControlRecord>& records = *cursor.records;
+    while (cursor.next < records.size() && records[cursor.next].sample <= cursor.sample)
+        cursor.value = records[cursor.next++].value / 65535.0f;
+    cursor.sample++;
+    return cursor.value;
+}
+
+// Header layout by session version: bytes in the file, and how many of them
+// are fields that version recorded. Later versions only appended fields,
+// except that version 1 left the FM bytes reserved (zero) and version 5
+// kept seq_bpm two bytes earlier than version 6.
+struct HeaderLayout
+{
+    size_t file_size;
+    size_t recorded;
+};
+
+constexpr HeaderLayout kHeaderLayouts[kSessionVersion + 1] = {
+    {0, 0},
+    {36, offsetof(SessionHeader, fm_preset)},                   // 1: UI state only
+    {36, 36},                                                   // 2: FM
+    {40, offsetof(SessionHeader, filter_cutoff)},               // 3: shaper
+    {40, 40},                                                   // 4: filter
+    {48, offsetof(SessionHeader, mod_preset)},                  // 5: envelopes, seq_bpm at 44
+    {48, 48},                                                   // 6: modulation
+    {sizeof(SessionHeader), sizeof(SessionHeader)},             // 7: partials
+};
+constexpr size_t kV5SeqBpmOffset = 44;
+
+// Read a header of any known version over the module's current UI state
+bool ReadHeader(FILE* f, SessionHeader& h)
+{
+    uint8_t raw[sizeof(SessionHeader)] = {0};
+    const size_t prefix = offsetof(SessionHeader, sample_rate);
+    if (std::fread(raw, prefix, 1, f) != 1)
+        return false;
+
+    SessionHeader file;
+    std::memcpy(&file, raw, prefix);
+    if (std::memcmp(file.magic, "SHRC", 4) != 0 || file.version == 0 || file.version > kSessionVersion)
+        return false;
+    const HeaderLayout& layout = kHeaderLayouts[file.version];
+    if (std::fread(raw + prefix, layout.file_size - prefix, 1, f) != 1)
+        return false;
+
+    SnapshotUiState(h);
+    std::memcpy(&h, raw, layout.recorded);
+    if (file.version == 5)
+        std::memcpy(&h.seq_bpm, raw + kV5SeqBpmOffset, sizeof(h.seq_bpm));
+    return true;
+}
+
+bool LoadSession(const char* path, Session& session)
+{
+    FILE* f = std::fopen(path, "rb");
+    if (f == nullptr)
+        return false;
+
+    bool ok = ReadHeader(f, session.header)
+              && session.header.record_size == sizeof(ControlRecord)
+              && session.header.block_size > 0 && session.header.block_size <= kMaxBlockSize;
+
+    ControlRecord record;
+    for (uint32_t n = 0; ok && n < session.header.num_records; n++)
+    {
+        if (std::fread(&record, sizeof(record), 1, f) != 1)
+            ok = false;
+        else if (record.kind == ControlKind::PITCH)
+            session.pitch.push_back(record);
+        else if (record.kind == ControlKind::GATE)
+            session.gate.push_back(record);
+        else if (record.kind == ControlKind::CV)
+            session.cv.push_back(record);
+        else
+            session.encoder.push_back(record);
+    }
+    std::fclose(f);
+    return ok;
+}
+
+// Put the UI back in the state the session started from
+void RestoreState(const SessionHeader& h)
+{
+    current_scale_idx = std::min<size_t>(h.scale, kNumScales - 1);
+    current_tuning_idx = std::min<size_t>(h.tuning, kNumTunings - 1);
+    root_note_midi = h.root_note_midi;
+    voice_mode = static_cast<VoiceMode>(std::min<size_t>(h.voice_mode, kNumVoiceModes - 1));
+    menu_state = static_cast<MenuState>(std::min<size_t>(h.menu_state, kNumMenuStates - 1));
+    menu_active = h.menu_active != 0;
+    display_mode = static_cast<DisplayMode>(std::min<size_t>(h.display_mode, kNumDisplayModes - 1));
+    current_fm_preset = std::min<size_t>(h.fm_preset, kNumFmPresets - 1);
+    fm_depth_percent = std::min<int>(h.fm_depth, kFmMaxDepth);
+    current_shaper_preset = std::min<size_t>(h.shaper_preset, kNumShaperPresets - 1);
+    shaper_drive_percent = std::min<int>(h.shaper_drive, kShaperMaxDrive);
+    filter_cutoff_step = std::min<int>(h.filter_cutoff, kFilterCutoffSteps);
+    filter_resonance_percent = std::min<int>(h.filter_resonance, kFilterMaxResonance);
+    current_env_preset = std::min<size_t>(h.env_preset, kNumEnvelopePresets - 1);
+    env_time_step = std::min<int>(h.env_time, kEnvTimeSteps);
+    env_cutoff_tenths = std::min<int>(h.env_cutoff, kEnvMaxCutoff);
+    seq_bpm = std::max<int>(kSeqMinBpm, std::min<int>(h.seq_bpm, kSeqMaxBpm));
+    current_mod_preset = std::min<size_t>(h.mod_preset, kNumModPresets - 1);
+    mod_depth_percent = std::min<int>(h.mod_depth, kModMaxDepth);
+    lfo_rate_step = std::min<int>(h.lfo_rate, kLfoRateSteps);
+    num_partials = std::max<int>(kMinPartials, std::min<int>(h.partials, kMaxPartials));
+    mod_routes_dirty = true;
+
+    RebuildTuningTable();
+    tuning_dirty = false;
+    PublishParams();
+}
+
+struct Timing
+{
+    double min_us = 1e9, max_us = 0.0, total_us = 0.0;
+    size_t count = 0;
+    uint32_t worst_sample = 0;
+
+    void Add(double us, uint32_t sample)
+    {
+        min_us = std::min(min_us, us);
+        if (us > max_us)
+        {
+            max_us = us;
+            worst_sample = sample;
+        }
+        total_us += us;
+        count++;
+    }
+
+    void Print(const char* name) const
+    {
+        std::printf("%-8s %8zu %8.2f %8.2f %8.2f  %10lu\n", name, count, count ? min_us : 0.0,
+                    count ? total_us / count : 0.0, max_us, static_cast<unsigned long>(worst_sample));
+    }
+};
+
+double ElapsedUs(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+}
+} // namespace
+
+int main(int argc, char** argv)
+{
+    if (argc < 2)
+    {
+        std::fprintf(stderr, "usage: %s session.shr\n", argv[0]);
+        return 2;
+    }
+
+    Session session;
+    if (!LoadSession(argv[1], session))
+    {
+        std::fprintf(stderr, "%s: not a readable session file\n", argv[1]);
+        return 1;
+    }
+    const SessionHeader& h = session.header;
+
+    System::Simulate(kClockStepUs);
+    patch.seed.LogMuted() = true;
+    InitModule();
+    RestoreState(h);
+
+    pitch_cursor.records = &session.pitch;
+    pitch_cursor.sample = h.first_sample;
+    patch.controls[CTRL_PITCH].SetSource(NextPitch, &pitch_cursor);
+
+    // Run until the last recorded input, plus one block
+    uint32_t last_sample = h.first_sample;
+    if (!session.pitch.empty())
+        last_sample = std::max(last_sample, session.pitch.back().sample);
+    if (!session.gate.empty())
+        last_sample = std::max(last_sample, session.gate.back().sample);
+    if (!session.cv.empty())
+        last_sample = std::max(last_sample, session.cv.back().sample);
+    if (!session.encoder.empty())
+        last_sample = std::max(last_sample, session.encoder.back().sample);
+    size_t num_blocks = (last_sample - h.first_sample) / h.block_size + 1;
+
+    float input_l[kMaxBlockSize] = {0.0f}, input_r[kMaxBlockSize] = {0.0f};
+    float output_l[kMaxBlockSize], output_r[kMaxBlockSize];
+    const float* in[2] = {input_l, input_r};
+    float* out[2] = {output_l, output_r};
+
+    sample_clock.store(h.first_sample);
+    size_t next_event = 0, next_gate = 0, next_cv = 0;
+    uint32_t hash = 2166136261u;
+    Timing audio, ui;
+    const uint32_t block_us = static_cast<uint32_t>(uint64_t(h.block_size) * 1000000u / h.sample_rate);
+
+    for (size_t b = 0; b < num_blocks; b++)
+    {
+        uint32_t block_start = h.first_sample + static_cast<uint32_t>(b * h.block_size);
+
+        // Deliver encoder input captured before this block, as the timer
+        // interrupt would have, then run the scheduler that reacts to it
+        while (next_event < session.encoder.size() && session.encoder[next_event].sample <= block_start)
+        {
+            const ControlRecord& r = session.encoder[next_event++];
+            uint32_t time_us = static_cast<uint32_t>(uint64_t(r.sample) * 1000000u / h.sample_rate);
+            EncoderEventKind kind = (r.kind == ControlKind::TURN)    ? EncoderEventKind::TURN
+                                    : (r.kind == ControlKind::PRESS) ? EncoderEventKind::PRESS
+                                                                     : EncoderEventKind::RELEASE;
+            encoder_events.Push({time_us, kind, r.delta});
+        }
+
+        // The callback reads the gate once per block, so a change lands on the
+        // block it was recorded at
+        while (next_gate < session.gate.size() && session.gate[next_gate].sample <= block_start)
+            patch.gate_input[DaisyPatch::GATE_IN_1].Set(session.gate[next_gate++].value != 0);
+
+        // CV 2-4 were read by the control task, which runs about once per block
+        while (next_cv < session.cv.size() && session.cv[next_cv].sample <= block_start)
+        {
+            const ControlRecord& r = session.cv[next_cv++];
+            if (r.delta >= 0 && r.delta < 3)
+                patch.controls[CTRL_CV2 + r.delta].SetValue(r.value / 65535.0f);
+        }
+
+        auto start = std::chrono::steady_clock::now();
+        RunScheduler();
+        ui.Add(ElapsedUs(start), block_start);
+
+        start = std::chrono::steady_clock::now();
+        AudioCallback(in, out, h.block_size);
+        audio.Add(ElapsedUs(start), block_start);
+
+        for (size_t i = 0; i < h.block_size; i++)
+        {
+            uint32_t bits[2];
+            std::memcpy(&bits[0], &output_l[i], sizeof(float));
+            std::memcpy(&bits[1], &output_r[i], sizeof(float));
+            hash = (hash ^ bits[0]) * 16777619u;
+            hash = (hash ^ bits[1]) * 16777619u;
+        }
+        System::AdvanceUs(block_us);
+    }
+
+    std::printf("session: %u Hz, %u-sample blocks, %zu pitch, %zu gate, %zu CV and %zu encoder records, %zu blocks\n",
+                static_cast<unsigned>(h.sample_rate), static_cast<unsigned>(h.block_size), session.pitch.size(),
+                session.gate.size(), session.cv.size(), session.encoder.size(), num_blocks);
+    std::printf("%-8s %8s %8s %8s %8s  %10s\n", "stage", "count", "min_us", "avg_us", "max_us", "worst_at");
+    audio.Print("audio");
+    ui.Print("ui");
+    std::printf("%u frames, output hash %08x, display hash %08x\n", static_cast<unsigned>(patch.display.FrameCount()),
+                hash, patch.display.Hash());
+    return 0;
+}
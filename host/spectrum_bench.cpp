@@ -0,0 +1,161 @@
+// Spectrum analyzer benchmark
+//
+// Checks and times SpectrumAnalyzer, the display's fixed-point FFT. A pure
+// sine on an analysis bin must peak on that bin with nothing else within
+// kSpurDb of it, and sines placed where each half-band stage would fold them
+// onto the same bin must land at least kAliasDb below it. The table then
+// lists the cost of each main-loop step and of the whole transform, and of
+// Capture per audio sample, best of several runs.
+//
+// Build (from the repository root):
+//   g++ -std=c++17 -O2 -DSUBHARMONIC_HOST -I. -I$LIBDAISY/src -I$DAISYSP/Source
+//       host/spectrum_bench.cpp oled_fonts.o -L$DAISYSP/build -ldaisysp -o spectrum_bench
+//
+// Usage:
+//   spectrum_bench [bin]
+
+#include "../subharmonicon.cpp"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+
+namespace
+{
+constexpr double kSampleRate = 48000.0;
+constexpr double kAnalysisRate = kSampleRate / kSpectrumDecimation;
+constexpr double kBinHz = kAnalysisRate / kFftSize;
+constexpr float kAmplitude = 0.5f;
+constexpr double kSpurDb = 50.0;   // Nothing but the tone's own Hann bins within this of the peak
+constexpr double kAliasDb = 60.0;  // Folded tones at least this far below an in-band one
+constexpr size_t kRuns = 50;
+constexpr size_t kCaptureSamples = 48000;
+constexpr const char* kStepNames[] = {"window", "stage 1", "stage 2", "stage 3", "stage 4", "reorder", "split",
+                                      "columns"};
+constexpr size_t kSteps = sizeof(kStepNames) / sizeof(kStepNames[0]);
+
+#if defined(__x86_64__) || defined(__i386__)
+constexpr const char* kCostUnit = "cycles";
+uint64_t ReadCost() { return __rdtsc(); }
+#else
+constexpr const char* kCostUnit = "ns";
+uint64_t ReadCost()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+#endif
+
+SpectrumAnalyzer analyzer;
+
+// Feed a sine through Capture until a snapshot is ready, then run the FFT
+void Analyze(double hz)
+{
+    analyzer.Init(static_cast<float>(kSampleRate));
+    analyzer.snapshot_ready.store(false);
+    for (size_t n = 0; !analyzer.snapshot_ready.load(); n++)
+        analyzer.Capture(kAmplitude * static_cast<float>(std::sin(2.0 * M_PI * hz * n / kSampleRate)));
+    while (!analyzer.Process())
+    {
+    }
+}
+
+// Strongest bin, skipping skip_lo..skip_hi
+size_t PeakBin(size_t skip_lo, size_t skip_hi)
+{
+    size_t peak = 1;
+    for (size_t k = 1; k < kFftComplexSize; k++)
+        if ((k < skip_lo || k > skip_hi) && analyzer.power_db[k] > analyzer.power_db[peak])
+            peak = k;
+    return peak;
+}
+
+// Best-of-runs cost of each Process step on the current snapshot
+void TimeSteps(uint64_t* best)
+{
+    for (size_t s = 0; s < kSteps; s++)
+        best[s] = UINT64_MAX;
+    for (size_t run = 0; run < kRuns; run++)
+    {
+        analyzer.snapshot_ready.store(true);
+        for (size_t s = 0; s < kSteps; s++)
+        {
+            uint64_t start = ReadCost();
+            analyzer.Process();
+            best[s] = std::min(best[s], ReadCost() - start);
+        }
+    }
+}
+
+// Best-of-runs cost of Capture per sample while it is filling a snapshot
+double CaptureCost()
+{
+    double best = 1e30;
+    for (size_t run = 0; run < kRuns / 10; run++)
+    {
+        analyzer.Init(static_cast<float>(kSampleRate));
+        float phase = 0.0f;
+        uint64_t start = ReadCost();
+        for (size_t n = 0; n < kCaptureSamples; n++)
+        {
+            analyzer.snapshot_ready.store(false, std::memory_order_relaxed);
+            analyzer.Capture(kAmplitude * SinCycle(phase));
+            phase = WrapCycle(phase + 1000.0f / static_cast<float>(kSampleRate));
+        }
+        best = std::min(best, static_cast<double>(ReadCost() - start) / kCaptureSamples);
+    }
+    return best;
+}
+} // namespace
+
+int main(int argc, char** argv)
+{
+    size_t bin = (argc > 1) ? static_cast<size_t>(std::atoi(argv[1])) : 64;
+    bin = std::max<size_t>(4, std::min(bin, static_cast<size_t>(kFftComplexSize * 0.8)));
+    bool ok = true;
+
+    // A pure sine peaks on its bin; Hann leaves it on that bin and its two
+    // neighbours, so anything further out is spur
+    Analyze(bin * kBinHz);
+    size_t peak = PeakBin(0, 0);
+    float peak_db = analyzer.power_db[peak];
+    size_t spur = PeakBin(bin - 1, bin + 1);
+    double spur_db = analyzer.power_db[spur] - peak_db;
+    bool sine_ok = peak == bin && spur_db <= -kSpurDb;
+    ok = ok && sine_ok;
+    std::printf("sine %.1f Hz: peak bin %zu (want %zu) at %.1f dB, worst spur %.1f dB at bin %zu  %s\n",
+                bin * kBinHz, peak, bin, peak_db, spur_db, spur, sine_ok ? "ok" : "FAILED");
+
+    // Tones mirrored about each stage's output Nyquist fold onto the test bin
+    // if that stage lets them through
+    for (double nyquist = kAnalysisRate / 2; nyquist < kSampleRate / 2; nyquist *= 2)
+    {
+        double hz = 2 * nyquist - bin * kBinHz;
+        Analyze(hz);
+        double alias_db = analyzer.power_db[bin] - peak_db;
+        bool alias_ok = alias_db <= -kAliasDb;
+        ok = ok && alias_ok;
+        std::printf("alias %.1f Hz: %.1f dB on bin %zu  %s\n", hz, alias_db, bin, alias_ok ? "ok" : "FAILED");
+    }
+
+    uint64_t best[kSteps];
+    TimeSteps(best);
+    uint64_t total = 0;
+    std::printf("\n%-8s %10s\n", "step", kCostUnit);
+    for (size_t s = 0; s < kSteps; s++)
+    {
+        std::printf("%-8s %10llu\n", kStepNames[s], static_cast<unsigned long long>(best[s]));
+        total += best[s];
+    }
+    std::printf("%-8s %10llu\n", "total", static_cast<unsigned long long>(total));
+    std::printf("capture  %10.1f per sample\n", CaptureCost());
+
+    std::printf("%s\n", ok ? "ok" : "FAILED");
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,221 @@
+// Flight-recorder trace decoder
+//
+// Reads a trace dumped by the module, either trace.bin from the SD card or a
+// USB serial log containing the "TRACE begin" ... "TRACE end" lines, and
+// prints it as a timeline with block times and a summary.
+//
+// Build (from the repository root):
+//   g++ -std=c++17 -O2 -DSUBHARMONIC_HOST -I. -I$LIBDAISY/src -I$DAISYSP/Source
+//       host/trace_decode.cpp oled_fonts.o -L$DAISYSP/build -ldaisysp -o trace_decode
+//
+// Usage:
+//   trace_decode trace.bin|serial.log
+
+#include "../subharmonicon.cpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+namespace
+{
+struct Trace
+{
+    TraceHeader header;
+    std::vector<TraceEvent> events;
+};
+
+bool LoadBinary(FILE* f, Trace& trace)
+{
+    if (std::fread(&trace.header, sizeof(TraceHeader), 1, f) != 1 || std::memcmp(trace.header.magic, "SHTR", 4) != 0
+        || trace.header.version != kTraceVersion || trace.header.event_size != sizeof(TraceEvent))
+        return false;
+
+    trace.events.resize(trace.header.num_events);
+    return std::fread(trace.events.data(), sizeof(TraceEvent), trace.events.size(), f) == trace.events.size();
+}
+
+// Serial logs may hold several dumps; the last complete one wins
+bool LoadSerialLog(FILE* f, Trace& trace)
+{
+    char line[256];
+    bool in_dump = false, found = false;
+    Trace current;
+    while (std::fgets(line, sizeof(line), f) != nullptr)
+    {
+        const char* text = std::strstr(line, "TR");
+        if (text == nullptr)
+            continue;
+
+        unsigned long a = 0, b = 0, c = 0;
+        if (std::sscanf(text, "TRACE begin %lu %lu %lu", &a, &b, &c) == 3)
+        {
+            current = Trace();
+            current.header.tick_freq = static_cast<uint32_t>(a);
+            current.header.block_ticks = static_cast<uint32_t>(b);
+            current.header.num_events = static_cast<uint32_t>(c);
+            in_dump = true;
+        }
+        else if (in_dump && std::strncmp(text, "TRACE end", 9) == 0)
+        {
+            trace = current;
+            in_dump = false;
+            found = true;
+        }
+        else if (in_dump && std::sscanf(text, "TR %lx %lx", &a, &b) == 2)
+        {
+            current.events.push_back({static_cast<uint32_t>(a), static_cast<uint32_t>(b)});
+        }
+    }
+    return found;
+}
+
+const char* TypeName(TraceType type)
+{
+    switch (type)
+    {
+        case TraceType::BLOCK_START: return "block";
+        case TraceType::BLOCK_END: return "end";
+        case TraceType::NOTE: return "note";
+        case TraceType::AUDIO_OVERRUN: return "OVERRUN";
+        case TraceType::SCALE: return "scale";
+        case TraceType::ROOT: return "root";
+        case TraceType::TUNING: return "tuning";
+        case TraceType::VOICE_MODE: return "mode";
+        case TraceType::TASK_OVERRUN: return "task-over";
+        case TraceType::DUMP: return "dump";
+        case TraceType::FM: return "fm";
+        case TraceType::SHAPER: return "shaper";
+        case TraceType::FILTER: return "filter";
+        case TraceType::ENVELOPE: return "envelope";
+        case TraceType::SEQ_RATE: return "seq";
+        case TraceType::MOD: return "mod";
+        case TraceType::PARTIALS: return "partials";
+    }
+    return "?";
+}
+} // namespace
+
+int main(int argc, char** argv)
+{
+    if (argc < 2)
+    {
+        std::fprintf(stderr, "usage: %s trace.bin|serial.log\n", argv[0]);
+        return 2;
+    }
+
+    FILE* f = std::fopen(argv[1], "rb");
+    if (f == nullptr)
+    {
+        std::perror(argv[1]);
+        return 1;
+    }
+    Trace trace;
+    bool ok = LoadBinary(f, trace);
+    if (!ok)
+    {
+        std::rewind(f);
+        ok = LoadSerialLog(f, trace);
+    }
+    std::fclose(f);
+    if (!ok || trace.events.empty() || trace.header.tick_freq == 0)
+    {
+        std::fprintf(stderr, "%s: no trace found\n", argv[1]);
+        return 1;
+    }
+
+    const TraceHeader& h = trace.header;
+    double us_per_tick = 1e6 / h.tick_freq;
+    uint32_t first = trace.events.front().tick;
+    uint32_t block_start = 0;
+    bool in_block = false;
+    double worst_block_us = 0.0, total_block_us = 0.0;
+    size_t blocks = 0, overruns = 0, task_overruns = 0;
+
+    std::printf("%12s  %-9s %s\n", "time_us", "event", "detail");
+    for (const TraceEvent& e : trace.events)
+    {
+        TraceType type = static_cast<TraceType>(e.info & 0xFF);
+        unsigned arg8 = (e.info >> 8) & 0xFF;
+        unsigned arg16 = e.info >> 16;
+        double t = (e.tick - first) * us_per_tick;
+
+        char detail[64] = "";
+        switch (type)
+        {
+            case TraceType::BLOCK_START:
+                block_start = e.tick;
+                in_block = true;
+                std::snprintf(detail, sizeof(detail), "%u samples", arg16);
+                break;
+            case TraceType::BLOCK_END:
+                if (in_block)
+                {
+                    double us = (e.tick - block_start) * us_per_tick;
+                    worst_block_us = std::max(worst_block_us, us);
+                    total_block_us += us;
+                    blocks++;
+                    std::snprintf(detail, sizeof(detail), "%.1f us (%.0f%%)", us,
+                                  h.block_ticks ? 100.0 * (e.tick - block_start) / h.block_ticks : 0.0);
+                }
+                in_block = false;
+                break;
+            case TraceType::NOTE: std::snprintf(detail, sizeof(detail), "%.2f Hz", arg16 / 4.0); break;
+            case TraceType::AUDIO_OVERRUN:
+                overruns++;
+                std::snprintf(detail, sizeof(detail), "%u%% of block period", arg16);
+                break;
+            case TraceType::SCALE:
+                std::snprintf(detail, sizeof(detail), "%s", arg8 < kNumScales ? scale_names[arg8] : "?");
+                break;
+            case TraceType::ROOT:
+                std::snprintf(detail, sizeof(detail), "%s%u", note_labels[arg16 % kNumNotes], arg16 / 12);
+                break;
+            case TraceType::TUNING:
+                std::snprintf(detail, sizeof(detail), "%s", arg8 < kNumTunings ? tunings[arg8].name : "?");
+                break;
+            case TraceType::VOICE_MODE:
+                std::snprintf(detail, sizeof(detail), "%s", arg8 < kNumVoiceModes ? voice_mode_names[arg8] : "?");
+                break;
+            case TraceType::TASK_OVERRUN:
+                task_overruns++;
+                std::snprintf(detail, sizeof(detail), "%s %u us", arg8 < kNumTasks ? tasks[arg8].name : "?", arg16);
+                break;
+            case TraceType::DUMP: std::snprintf(detail, sizeof(detail), "%s", arg16 ? "on overrun" : "requested"); break;
+            case TraceType::FM:
+                std::snprintf(detail, sizeof(detail), "%s %u%%", arg8 < kNumFmPresets ? fm_presets[arg8].name : "?", arg16);
+                break;
+            case TraceType::SHAPER:
+                std::snprintf(detail, sizeof(detail), "%s %u%%",
+                              arg8 < kNumShaperPresets ? shaper_presets[arg8].name : "?", arg16);
+                break;
+            case TraceType::FILTER:
+                if (static_cast<int>(arg8) >= kFilterCutoffSteps)
+                    std::snprintf(detail, sizeof(detail), "open, %u%%", arg16);
+                else
+                    std::snprintf(detail, sizeof(detail), "%.0f Hz, %u%%", FilterCutoffHz(arg8), arg16);
+                break;
+            case TraceType::ENVELOPE:
+                std::snprintf(detail, sizeof(detail), "%s %.0f ms, %.1f oct",
+                              arg8 < kNumEnvelopePresets ? envelope_presets[arg8].name : "?",
+                              EnvelopeTime(arg16 & 0xFF) * 1000.0f, (arg16 >> 8) / 10.0f);
+                break;
+            case TraceType::SEQ_RATE: std::snprintf(detail, sizeof(detail), "%u BPM", arg16); break;
+            case TraceType::MOD:
+                std::snprintf(detail, sizeof(detail), "%s %u%%, LFO %.2f Hz",
+                              arg8 < kNumModPresets ? mod_presets[arg8].name : "?", arg16 & 0xFF,
+                              LfoRateHz(arg16 >> 8));
+                break;
+            case TraceType::PARTIALS: std::snprintf(detail, sizeof(detail), "%u", arg8); break;
+        }
+        std::printf("%12.1f  %-9s %s\n", t, TypeName(type), detail);
+    }
+
+    std::printf("\n%zu events over %.1f ms; %zu blocks, avg %.1f us, worst %.1f us of %.1f us; "
+                "%zu audio overruns, %zu task overruns\n",
+                trace.events.size(), (trace.events.back().tick - first) * us_per_tick / 1000.0, blocks,
+                blocks ? total_block_us / blocks : 0.0, worst_block_us, h.block_ticks * us_per_tick, overruns,
+                task_overruns);
+    return 0;
+}
@@ -1,33 +1,332 @@
+#if defined(SUBHARMONIC_HOST)
+#include "host/host_patch.h" // Desktop stand-in for the Patch hardware
+#else
 #include "daisy_patch.h"
+#endif
 #include "daisysp.h"
+#include <algorithm>
 #include <array>
-#include <vector>
-#include <string>
+#include <atomic>
 #include <cmath>
+#include <cstdint>
 #include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
 
 using namespace daisy;
 using namespace daisysp;
 
+// Heap Guard
+// All tables are constant data and nothing allocates once running. Building
+// with -DSUBHARMONIC_NO_HEAP replaces every form of operator new (plain,
+// nothrow and aligned) and, through the linker's --wrap, malloc, calloc and
+// realloc, to count allocations and trap on any made after LockHeap(), so a
+// stray one shows up at its call site instead of as allocator jitter. That
+// build links with -Wl,--wrap=malloc,--wrap=calloc,--wrap=realloc.
+size_t heap_allocations = 0;
+bool heap_locked = false;
+
+void LockHeap()
+{
+    heap_locked = true;
+}
+
+#if defined(SUBHARMONIC_NO_HEAP)
+extern "C" void* __real_malloc(size_t size);
+extern "C" void* __real_calloc(size_t count, size_t size);
+extern "C" void* __real_realloc(void* ptr, size_t size);
+
+// Helper: Count an allocation, trapping once the heap is locked
+inline void GuardAllocation()
+{
+    heap_allocations++;
+    if (heap_locked)
+        __builtin_trap();
+}
+
+extern "C" void* __wrap_malloc(size_t size)
+{
+    GuardAllocation();
+    return __real_malloc(size);
+}
+
+extern "C" void* __wrap_calloc(size_t count, size_t size)
+{
+    GuardAllocation();
+    return __real_calloc(count, size);
+}
+
+extern "C" void* __wrap_realloc(void* ptr, size_t size)
+{
+    GuardAllocation();
+    return __real_realloc(ptr, size);
+}
+
+// Helper: Allocate for operator new; aligned_alloc needs a multiple of align
+void* GuardedNew(size_t size, size_t align)
+{
+    GuardAllocation();
+    void* ptr = (align <= alignof(std::max_align_t))
+                    ? __real_malloc(size)
+                    : std::aligned_alloc(align, (size + align - 1) & ~(align - 1));
+    if (ptr == nullptr)
+        __builtin_trap();
+    return ptr;
+}
+
+void* operator new(size_t size)
+{
+    return GuardedNew(size, 0);
+}
+
+void* operator new[](size_t size)
+{
+    return GuardedNew(size, 0);
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept
+{
+    return GuardedNew(size, 0);
+}
+
+void* operator new[](size_t size, const std::nothrow_t&) noexcept
+{
+    return GuardedNew(size, 0);
+}
+
+void* operator new(size_t size, std::align_val_t align)
+{
+    return GuardedNew(size, static_cast<size_t>(align));
+}
+
+void* operator new[](size_t size, std::align_val_t align)
+{
+    return GuardedNew(size, static_cast<size_t>(align));
+}
+
+void* operator new(size_t size, std::align_val_t align, const std::nothrow_t&) noexcept
+{
+    return GuardedNew(size, static_cast<size_t>(align));
+}
+
+void* operator new[](size_t size, std::align_val_t align, const std::nothrow_t&) noexcept
+{
+    return GuardedNew(size, static_cast<size_t>(align));
+}
+
+// Every form of delete frees; aligned_alloc memory goes back through free too
+void operator delete(void* ptr) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete[](void* ptr) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete(void* ptr, size_t) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete[](void* ptr, size_t) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete(void* ptr, const std::nothrow_t&) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete[](void* ptr, const std::nothrow_t&) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete(void* ptr, std::align_val_t) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete[](void* ptr, std::align_val_t) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete(void* ptr, size_t, std::align_val_t) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete[](void* ptr, size_t, std::align_val_t) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete(void* ptr, std::align_val_t, const std::nothrow_t&) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete[](void* ptr, std::align_val_t, const std::nothrow_t&) noexcept
+{
+    std::free(ptr);
+}
+#endif
+
+// Tightly Coupled Memory
+// The audio path runs from ITCM and keeps its state and tables in DTCM. Both
+// are zero wait state and bypass the cache, so block timing doesn't depend on
+// what the UI touched last. tcm_sections.ld places the sections and
+// check_tcm.sh verifies a cross-built ELF.
+//   ITCM_CODE         audio-path functions, copied from flash at boot
+//   DTCM_RODATA       constant tables, copied from flash at boot
+//   DTCM_MEM_SECTION  libDaisy's DTCM section, zeroed at boot; only for
+//                     objects whose zero state is valid or that Init() sets up
+// Every ITCM function gets a section of its own: inline members are emitted
+// in COMDAT groups, and GCC won't mix those with plain functions in one
+// named section.
+#if defined(SUBHARMONIC_HOST)
+#define ITCM_CODE
+#define DTCM_RODATA
+#else
+#define TCM_SECTION_NAME(prefix, n) __attribute__((section(prefix #n)))
+#define TCM_SECTION(prefix, n) TCM_SECTION_NAME(prefix, n)
+#define ITCM_CODE TCM_SECTION(".itcm_text.", __COUNTER__)
+#define DTCM_RODATA __attribute__((section(".dtcm_rodata")))
+
+extern "C" uint32_t _sitcm_text, _eitcm_text, _litcm_text;
+extern "C" uint32_t _sdtcm_data, _edtcm_data, _ldtcm_data;
+extern "C" uint32_t _sdtcmram_bss, _edtcmram_bss;
+
+// Fill the TCM sections ahead of every static constructor. ITCM starts at
+// address 0, so this copies through volatile pointers rather than memcpy.
+__attribute__((constructor(101))) void InitTcmSections()
+{
+    volatile uint32_t* dst = &_sitcm_text;
+    const uint32_t* src = &_litcm_text;
+    while (dst < &_eitcm_text)
+        *dst++ = *src++;
+
+    dst = &_sdtcm_data;
+    src = &_ldtcm_data;
+    while (dst < &_edtcm_data)
+        *dst++ = *src++;
+
+    for (dst = &_sdtcmram_bss; dst < &_edtcmram_bss;)
+        *dst++ = 0;
+}
+#endif
+
 // Enumeration for display modes
 enum class DisplayMode
 {
     WAVEFORM,
-    XY
+    XY,
+    PHOSPHOR, // XY with decaying persistence
+    SPECTRUM, // Log-frequency FFT of the output
+    TUNER     // Quantized note and subharmonic frequencies
 };
 
 // Enumeration for menu states
 enum class MenuState
 {
     SCALE_SELECTION,
-    ROOT_NOTE_SELECTION
+    ROOT_NOTE_SELECTION,
+    TUNING_SELECTION,
+    MODE_SELECTION,
+    CALIBRATION,
+    RECORDER,
+    TRACE,
+    FM_ROUTING,
+    FM_DEPTH,
+    SHAPER,
+    SHAPER_DRIVE,
+    FILTER_CUTOFF,
+    FILTER_RESONANCE,
+    ENVELOPE,
+    ENV_TIME,
+    ENV_CUTOFF,
+    SEQ_RATE,
+    MOD_ROUTING,
+    MOD_DEPTH,
+    LFO_RATE,
+    PARTIALS
+};
+
+// Enumeration for voice modes
+enum class VoiceMode
+{
+    OSCILLATORS, // Sine subharmonics of the quantized pitch
+    RESONATOR,   // Audio input excites resonators tuned to the subharmonics
+    ADDITIVE     // Large undertone stack from quadrature oscillators
+};
+
+// Enumeration for oscillator cross-modulation
+enum class FmMode : uint8_t
+{
+    OFF,
+    PM,   // Sources offset the targets' phase
+    TZFM  // Sources scale the targets' frequency, through zero
+};
+
+// Enumeration for the nonlinear stage on the mix
+enum class ShaperMode : uint8_t
+{
+    OFF,
+    FOLD,  // Triangle wavefolder
+    TANH,  // Symmetric soft saturation
+    ASYM   // Soft positive clip, hard negative clip (even harmonics)
+};
+
+// Enumeration for envelope trigger sources
+enum class EnvTrigger : uint8_t
+{
+    OFF,       // Drone, no envelopes
+    GATE,      // Gate input 1
+    SEQUENCER  // Internal step clock
+};
+
+// Enumeration for modulation sources, all bipolar
+enum class ModSource : uint8_t
+{
+    CV2,   // Control 1 (knob plus CV)
+    CV3,   // Control 2
+    CV4,   // Control 3
+    LFO1,  // Sine at the LFO page rate
+    LFO2   // Sine at kLfo2Ratio times that
+};
+
+// Enumeration for modulation targets
+enum class ModTarget : uint8_t
+{
+    RATIO,     // Every subharmonic divisor, in whole steps
+    LEVEL,     // Output level, in octaves of gain
+    SCALE,     // Scale index
+    ROOT,      // Root note, in semitones
+    FM_DEPTH,  // FM depth, in percent
+    CUTOFF     // Filter cutoff, in semitones
+};
+
+// Enumeration for tuning families
+enum class TuningKind
+{
+    EQUAL,    // N equal divisions of the octave
+    JUST_12,  // 5-limit just intonation, 12 notes
+    JUST_8,   // 7-limit just intonation, 8 notes
+    SCALA     // Loaded from a Scala .scl/.kbm pair
 };
 
 // Enumeration for control indices
 enum ControlIndex
 {
     CTRL_PITCH = 0,
-    // Add other controls here if needed
+    CTRL_CV2,   // Modulation sources
+    CTRL_CV3,
+    CTRL_CV4
 };
 
 // Daisy Patch instance
@@ -39,38 +338,110 @@ constexpr size_t kWaveformBufferSize = 128;
 constexpr size_t kNumScales = 25;
 constexpr size_t kNumNotes = 12;
 constexpr size_t kNumOctaves = 9;
+constexpr size_t kNumVoiceModes = 3;
+constexpr size_t kNumMenuStates = 21;
+constexpr size_t kNumDisplayModes = 5;
+constexpr size_t kNumTunings = 8;
+constexpr size_t kMaxTuningDegrees = 128;
+constexpr size_t kMaxTuningNotes = 1024;
+constexpr float kMinTuningFrequency = 4.0f;
+constexpr float kMaxTuningFrequency = 16000.0f;
+constexpr size_t kScalaFileSize = 4096;
+constexpr size_t kScopeBuckets = 128;
+constexpr float kScopeCycles = 2.0f;           // Periods of the lowest subharmonic per trace
+constexpr float kScopeHysteresis = 0.02f;      // Trigger re-arms below -hysteresis
+constexpr uint32_t kScopeAutoTrigger = 24000;  // Free-run if no edge within this many samples
+constexpr size_t kDisplayWidth = 128;
+constexpr size_t kDisplayHeight = 64;
+constexpr uint8_t kPhosphorHit = 96;            // Intensity added per plotted sample
+constexpr size_t kColumnsPerUnit = 16;          // Render slice granularity for column views
+constexpr size_t kRowsPerUnit = 8;              // Render slice granularity for row views
+constexpr uint32_t kFrameIntervalUs = 16667;    // Idle frame rate (60 Hz)
+constexpr size_t kFftSize = 512;                // Real input samples per spectrum
+constexpr size_t kFftComplexSize = kFftSize / 2;
+constexpr size_t kFftStages = 4;                // log4(kFftComplexSize)
+constexpr size_t kSpectrumDecimation = 8;       // 48 kHz -> 6 kHz analysis rate, three half-band stages
+constexpr size_t kSpectrumSettle = 64;          // Decimated samples dropped while the filters settle
+constexpr float kSpectrumMinHz = 20.0f;
+constexpr float kSpectrumRangeDb = 64.0f;       // One pixel per dB
+constexpr float kResonatorQ = 40.0f;
+constexpr size_t kMaxPartials = 64;
+constexpr size_t kDefaultPartials = 32;
+constexpr size_t kMinPartials = 2;              // One undertone per channel
+constexpr size_t kNumCalibrationPoints = 4;
+constexpr size_t kCvTableSize = 257;
+constexpr float kCvFullScaleVolts = 5.0f;
+constexpr float kCvBaseFrequency = 32.703196f; // C1 at 0V
+constexpr size_t kNumFmOperators = kNumSubharmonics + 1; // Master sine plus the subharmonics
+constexpr size_t kNumFmPresets = 9;
+constexpr int kFmMaxDepth = 100;                // Percent
+constexpr size_t kMaxBlockSize = 256;           // Samples per engine call
+constexpr size_t kNumShaperPresets = 7;
+constexpr int kShaperMaxDrive = 100;            // Percent
+constexpr size_t kMaxOversampling = 4;
+constexpr size_t kHalfBandCoefs2x = 8;          // Allpass sections, 48 <-> 96 kHz
+constexpr size_t kHalfBandCoefs4x = 4;          // Allpass sections, 96 <-> 192 kHz
+constexpr int kFilterCutoffSteps = 120;         // Semitones above kFilterMinHz; the last step is open
+constexpr float kFilterMinHz = 20.0f;
+constexpr int kFilterMaxResonance = 100;        // Percent
+constexpr float kFilterMaxFeedback = 4.0f;      // Ladder self-oscillates here
+constexpr float kFilterGlide = 0.005f;          // Seconds, cutoff and resonance smoothing
+constexpr size_t kNumEnvelopePresets = 5;
+constexpr int kEnvTimeSteps = 54;               // Sixth-octave steps above kEnvMinTime
+constexpr float kEnvMinTime = 0.01f;            // Seconds
+constexpr float kEnvFloor = 1e-4f;              // -80 dB, where a decay ends
+constexpr int kEnvMaxCutoff = 60;               // Tenths of an octave
+constexpr int kSeqMinBpm = 30;
+constexpr int kSeqMaxBpm = 300;
+constexpr size_t kNumModSources = 5;
+constexpr size_t kNumModTargets = 6;
+constexpr size_t kMaxModRoutes = 8;
+constexpr size_t kNumModPresets = 8;
+constexpr int kModMaxDepth = 100;               // Percent
+constexpr int kLfoRateSteps = 48;               // Sixth-octave steps above kLfoMinHz
+constexpr float kLfoMinHz = 0.02f;
+constexpr float kLfo2Ratio = 0.618034f;         // Keeps the two LFOs drifting against each other
+constexpr float kMaxControlGap = 0.1f;          // Seconds; longest LFO step, for the first tick after boot
+constexpr float kMaxRatio = 16.0f;              // Largest subharmonic divisor
 
 // Quantizer Scales
-std::vector<std::vector<float>> scales = {
-    {0, 2, 4, 5, 7, 9, 11},       // Major (Ionian)
-    {0, 2, 3, 5, 7, 8, 10},       // Minor (Aeolian)
-    {0, 2, 5, 7, 9},              // Pentatonic
-    {0, 2, 3, 5, 7, 9, 10},       // Dorian
-    {0, 1, 3, 5, 7, 8, 10},       // Phrygian
-    {0, 2, 4, 6, 7, 9, 11},       // Lydian
-    {0, 2, 4, 5, 7, 9, 10},       // Mixolydian
-    {0, 1, 3, 5, 6, 8, 10},       // Locrian
-    {0, 2, 4, 6, 8, 10},          // Whole Tone
-    {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11}, // Chromatic
-    {0, 3, 5, 6, 7, 10},           // Blues
-    {0, 2, 3, 5, 7, 8, 11},        // Harmonic Minor
-    {0, 2, 3, 5, 7, 9, 11},        // Melodic Minor
-    {0, 1, 4, 5, 7, 8, 11},        // Hungarian Minor
-    {0, 1, 4, 5, 7, 8, 10},        // Phrygian Dominant
-    {0, 1, 4, 5, 7, 8, 11},        // Double Harmonic
-    {0, 1, 3, 6, 7, 10},           // Enigmatic
-    {0, 1, 4, 5, 7, 9, 11},        // Persian
-    {0, 1, 5, 7, 8, 11},           // Japanese
-    {0, 1, 3, 5, 7, 8, 10},        // Neopolitan Minor
-    {0, 1, 4, 5, 7, 9, 11},        // Neopolitan Major
-    {0, 2, 4, 5, 7, 9, 10, 11},    // Bebop Major
-    {0, 2, 3, 5, 7, 9, 10, 11},    // Bebop Minor
-    {0, 2, 4, 5, 8, 9, 11},        // Ionian Augmented
-    {0, 2, 4, 5, 7, 9, 10}         // Lydian Dominant
+// Semitone degrees above the root
+struct Scale
+{
+    uint8_t size;
+    uint8_t notes[kNumNotes];
+};
+
+constexpr Scale scales[kNumScales] = {
+    {7, {0, 2, 4, 5, 7, 9, 11}},                   // Major (Ionian)
+    {7, {0, 2, 3, 5, 7, 8, 10}},                   // Minor (Aeolian)
+    {5, {0, 2, 5, 7, 9}},                          // Pentatonic
+    {7, {0, 2, 3, 5, 7, 9, 10}},                   // Dorian
+    {7, {0, 1, 3, 5, 7, 8, 10}},                   // Phrygian
+    {7, {0, 2, 4, 6, 7, 9, 11}},                   // Lydian
+    {7, {0, 2, 4, 5, 7, 9, 10}},                   // Mixolydian
+    {7, {0, 1, 3, 5, 6, 8, 10}},                   // Locrian
+    {6, {0, 2, 4, 6, 8, 10}},                      // Whole Tone
+    {12, {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11}},  // Chromatic
+    {6, {0, 3, 5, 6, 7, 10}},                      // Blues
+    {7, {0, 2, 3, 5, 7, 8, 11}},                   // Harmonic Minor
+    {7, {0, 2, 3, 5, 7, 9, 11}},                   // Melodic Minor
+    {7, {0, 1, 4, 5, 7, 8, 11}},                   // Hungarian Minor
+    {7, {0, 1, 4, 5, 7, 8, 10}},                   // Phrygian Dominant
+    {7, {0, 1, 4, 5, 7, 8, 11}},                   // Double Harmonic
+    {6, {0, 1, 3, 6, 7, 10}},                      // Enigmatic
+    {7, {0, 1, 4, 5, 7, 9, 11}},                   // Persian
+    {6, {0, 1, 5, 7, 8, 11}},                      // Japanese
+    {7, {0, 1, 3, 5, 7, 8, 10}},                   // Neopolitan Minor
+    {7, {0, 1, 4, 5, 7, 9, 11}},                   // Neopolitan Major
+    {8, {0, 2, 4, 5, 7, 9, 10, 11}},               // Bebop Major
+    {8, {0, 2, 3, 5, 7, 9, 10, 11}},               // Bebop Minor
+    {7, {0, 2, 4, 5, 8, 9, 11}},                   // Ionian Augmented
+    {7, {0, 2, 4, 5, 7, 9, 10}}                    // Lydian Dominant
 };
 
 // Scale Names
-std::array<std::string, kNumScales> scale_names = {
+constexpr const char* scale_names[kNumScales] = {
     "Major",
     "Minor",
     "Pentatonic",
@@ -99,226 +470,3642 @@ std::array<std::string, kNumScales> scale_names = {
 };
 
 // Note Labels
-std::array<std::string, kNumNotes> note_labels = {
+constexpr const char* note_labels[kNumNotes] = {
     "C", "C#", "D", "D#", "E", "F",
     "F#", "G", "G#", "A", "A#", "B"
 };
 
+// Tuning Systems
+// Twelve-note tunings are filtered through the selected scale; the others use
+// every degree of the tuning.
+struct TuningSystem
+{
+    const char* name;
+    TuningKind kind;
+    size_t divisions;
+};
+
+constexpr TuningSystem tunings[kNumTunings] = {
+    {"12-TET", TuningKind::EQUAL, 12},
+    {"12-JI", TuningKind::JUST_12, 12},
+    {"8-JI", TuningKind::JUST_8, 8},
+    {"19-EDO", TuningKind::EQUAL, 19},
+    {"22-EDO", TuningKind::EQUAL, 22},
+    {"24-EDO", TuningKind::EQUAL, 24},
+    {"31-EDO", TuningKind::EQUAL, 31},
+    {"Scala", TuningKind::SCALA, 0}
+};
+
+constexpr float ji_12_ratios[12] = {
+    1.0f, 16.0f / 15.0f, 9.0f / 8.0f, 6.0f / 5.0f, 5.0f / 4.0f, 4.0f / 3.0f,
+    45.0f / 32.0f, 3.0f / 2.0f, 8.0f / 5.0f, 5.0f / 3.0f, 9.0f / 5.0f, 15.0f / 8.0f
+};
+
+constexpr float ji_8_ratios[8] = {
+    1.0f, 9.0f / 8.0f, 5.0f / 4.0f, 4.0f / 3.0f, 3.0f / 2.0f, 5.0f / 3.0f, 7.0f / 4.0f, 15.0f / 8.0f
+};
+
+// Voice Mode Names
+constexpr const char* voice_mode_names[kNumVoiceModes] = {
+    "Oscillators",
+    "Resonator",
+    "Additive"
+};
+
+// FM Routing Presets
+// Route depths as [source][target] over the operators: 0 is a master sine at
+// the quantized pitch, which is not heard itself, and 1..4 are the
+// subharmonics /2, /3, /4 and /5. A PM depth of 1 is a phase offset of one
+// cycle; a TZFM depth of 1 swings the target's frequency by 100%. The FM depth
+// page scales the whole matrix.
+struct FmPreset
+{
+    const char* name;
+    FmMode mode;
+    float depth[kNumFmOperators][kNumFmOperators];
+};
+
+constexpr FmPreset fm_presets[kNumFmPresets] = {
+    {"Off", FmMode::OFF, {}},
+    {"Master PM", FmMode::PM, {{0.0f, 0.5f, 0.5f, 0.5f, 0.5f}}},
+    {"Chain PM", FmMode::PM, {{}, {0.0f, 0.0f, 0.5f}, {0.0f, 0.0f, 0.0f, 0.5f}, {0.0f, 0.0f, 0.0f, 0.0f, 0.5f}}},
+    {"Undertone PM", FmMode::PM, {{}, {}, {}, {}, {0.0f, 0.5f, 0.5f, 0.5f}}},
+    {"Feedback PM", FmMode::PM, {{}, {0.0f, 0.25f}, {0.0f, 0.0f, 0.25f}, {0.0f, 0.0f, 0.0f, 0.25f}, {0.0f, 0.0f, 0.0f, 0.0f, 0.25f}}},
+    {"Master TZ", FmMode::TZFM, {{0.0f, 2.0f, 2.0f, 2.0f, 2.0f}}},
+    {"Chain TZ", FmMode::TZFM, {{}, {0.0f, 0.0f, 2.0f}, {0.0f, 0.0f, 0.0f, 2.0f}, {0.0f, 0.0f, 0.0f, 0.0f, 2.0f}}},
+    {"Cross TZ", FmMode::TZFM, {{}, {0.0f, 0.0f, 1.5f}, {0.0f, 1.5f}, {0.0f, 0.0f, 0.0f, 0.0f, 1.5f}, {0.0f, 0.0f, 0.0f, 1.5f}}},
+    {"Loop TZ", FmMode::TZFM, {{0.0f, 1.5f, 1.5f, 1.5f}, {}, {}, {}, {1.0f}}}
+};
+
+// Shaper Presets
+// Curve and oversampling factor for the nonlinear stage. Drive sets the gain
+// into the curve, from unity at 0% to 8x at 100%.
+struct ShaperPreset
+{
+    const char* name;
+    ShaperMode mode;
+    uint8_t factor;   // Oversampling: 1, 2 or 4
+};
+
+constexpr ShaperPreset shaper_presets[kNumShaperPresets] = {
+    {"Off", ShaperMode::OFF, 1},
+    {"Fold 2x", ShaperMode::FOLD, 2},
+    {"Fold 4x", ShaperMode::FOLD, 4},
+    {"Tanh 2x", ShaperMode::TANH, 2},
+    {"Tanh 4x", ShaperMode::TANH, 4},
+    {"Asym 2x", ShaperMode::ASYM, 2},
+    {"Asym 4x", ShaperMode::ASYM, 4}
+};
+
+// Envelope Presets
+// Trigger source and the shape of the two envelopes, one on the output level
+// and one on the filter cutoff. Segment times are fractions of the Time
+// page; an AD envelope runs through once per trigger, while an ADSR one
+// holds its sustain level until the gate falls.
+struct EnvelopeShape
+{
+    float attack;
+    float decay;      // To -60 dB, or most of the way to sustain
+    float sustain;
+    float release;    // To -60 dB
+    bool hold;        // ADSR
+};
+
+struct EnvelopePreset
+{
+    const char* name;
+    EnvTrigger trigger;
+    EnvelopeShape amp;
+    EnvelopeShape filter;
+};
+
+constexpr EnvelopePreset envelope_presets[kNumEnvelopePresets] = {
+    {"Off", EnvTrigger::OFF, {}, {}},
+    {"Gate AD", EnvTrigger::GATE, {0.02f, 1.0f, 0.0f, 0.0f, false}, {0.01f, 0.5f, 0.0f, 0.0f, false}},
+    {"Gate ADSR", EnvTrigger::GATE, {0.1f, 0.5f, 0.7f, 1.0f, true}, {0.05f, 0.5f, 0.3f, 1.0f, true}},
+    {"Seq AD", EnvTrigger::SEQUENCER, {0.02f, 1.0f, 0.0f, 0.0f, false}, {0.01f, 0.5f, 0.0f, 0.0f, false}},
+    {"Seq ADSR", EnvTrigger::SEQUENCER, {0.1f, 0.5f, 0.7f, 1.0f, true}, {0.05f, 0.5f, 0.3f, 1.0f, true}}
+};
+
+// Modulation Presets
+// Sparse route lists for the modulation matrix. An amount of 1 swings the
+// target by its full span either way at full depth; the Depth page scales
+// every route.
+struct ModRoute
+{
+    ModSource source;
+    ModTarget target;
+    float amount;
+};
+
+struct ModPreset
+{
+    const char* name;
+    uint8_t num_routes;
+    ModRoute routes[kMaxModRoutes];
+};
+
+// Span of each target for a route amount of 1
+constexpr float mod_target_spans[kNumModTargets] = {
+    8.0f,    // Divisor steps
+    1.0f,    // Octaves of gain (6 dB)
+    12.0f,   // Scales
+    24.0f,   // Semitones of root
+    100.0f,  // Percent of FM depth
+    60.0f    // Semitones of cutoff
+};
+
+constexpr ModPreset mod_presets[kNumModPresets] = {
+    {"Off", 0, {}},
+    {"CV ratio", 3,
+     {{ModSource::CV2, ModTarget::RATIO, 1.0f}, {ModSource::CV3, ModTarget::ROOT, 1.0f},
+      {ModSource::CV4, ModTarget::FM_DEPTH, 1.0f}}},
+    {"CV scale", 3,
+     {{ModSource::CV2, ModTarget::SCALE, 1.0f}, {ModSource::CV3, ModTarget::CUTOFF, 1.0f},
+      {ModSource::CV4, ModTarget::LEVEL, 1.0f}}},
+    {"LFO level", 1, {{ModSource::LFO1, ModTarget::LEVEL, 1.0f}}},
+    {"LFO ratio", 2, {{ModSource::LFO1, ModTarget::RATIO, 0.5f}, {ModSource::LFO2, ModTarget::FM_DEPTH, 0.5f}}},
+    {"LFO filter", 2, {{ModSource::LFO1, ModTarget::CUTOFF, 0.5f}, {ModSource::LFO2, ModTarget::CUTOFF, 0.25f}}},
+    {"LFO roots", 2, {{ModSource::LFO2, ModTarget::ROOT, 0.5f}, {ModSource::LFO1, ModTarget::SCALE, 0.25f}}},
+    {"CV + LFO", 4,
+     {{ModSource::CV2, ModTarget::RATIO, 1.0f}, {ModSource::CV3, ModTarget::LEVEL, 0.5f},
+      {ModSource::LFO1, ModTarget::FM_DEPTH, 0.5f}, {ModSource::LFO2, ModTarget::CUTOFF, 0.5f}}}
+};
+
 // Global Variables
 size_t current_scale_idx = 0;
 int root_note_midi = 69; // Default root note (A4)
+VoiceMode voice_mode = VoiceMode::OSCILLATORS;
+size_t current_tuning_idx = 0;
+size_t current_fm_preset = 0;
+int fm_depth_percent = 50;
+size_t current_shaper_preset = 0;
+int shaper_drive_percent = 25;
+int filter_cutoff_step = kFilterCutoffSteps;
+int filter_resonance_percent = 0;
+size_t current_env_preset = 0;
+int env_time_step = 24;
+int env_cutoff_tenths = 30;
+int seq_bpm = 120;
+size_t current_mod_preset = 0;
+int mod_depth_percent = 50;
+int lfo_rate_step = 24;
+int num_partials = static_cast<int>(kDefaultPartials);
+bool tuning_dirty = true;
+bool params_dirty = false;
 
-// Oscillators
-std::array<Oscillator, kNumSubharmonics> subharmonics;
-const float subharmonic_ratios[kNumSubharmonics] = {2.0f, 3.0f, 4.0f, 5.0f};
+// Scala Tuning
+// Degrees from the last loaded .scl file as ratios above 1/1, with the final
+// degree as the period. A .kbm file, if present, pins its reference note to
+// its reference frequency; its key mapping list is not used.
+struct ScalaTuning
+{
+    size_t num_degrees = 0;
+    float ratios[kMaxTuningDegrees];
+    float period = 2.0f;
+    bool has_keyboard_map = false;
+    int middle_note = 60;
+    int reference_note = 69;
+    float reference_freq = 440.0f;
+};
 
-// Waveform Buffers
-std::array<float, kWaveformBufferSize> osc_buffer_l = {0.0f};
-std::array<float, kWaveformBufferSize> osc_buffer_r = {0.0f};
-size_t buffer_index = 0;
+ScalaTuning scala_tuning;
 
-// UI State
-DisplayMode display_mode = DisplayMode::WAVEFORM;
-MenuState menu_state = MenuState::SCALE_SELECTION;
-bool menu_active = false;
+// Tuning Tables
+// Every pitch of the current tuning, scale and root between the tuning
+// frequency limits, sorted ascending so Quantize() is a binary search. The
+// audio callback reads its copy from the engine parameter block.
+struct TuningTable
+{
+    size_t size = 0;
+    float freqs[kMaxTuningNotes];
+};
 
-// Debounce Variables for Encoder
-bool last_encoder_pressed = false;
+// SD Card (Scala import)
+SdmmcHandler sd_card;
+FatFSInterface sd_fs;
+FIL sd_file;
+bool sd_mounted = false;
+char scala_text[kScalaFileSize];
 
-// Helper: Convert MIDI note to frequency
-float MidiToFrequency(int midi_note)
-{
-    return 440.0f * powf(2.0f, (midi_note - 69) / 12.0f);
-}
+// Pitch CV Calibration
+// Raw ADC readings captured with known voltages patched into the pitch input.
+// They are stored in QSPI and expanded into a dense reading -> frequency table,
+// so the audio path only interpolates and never evaluates exp2.
+const float calibration_volts[kNumCalibrationPoints] = {1.0f, 2.0f, 3.0f, 4.0f};
 
-// Helper: Quantize Frequency
-float Quantize(float freq)
+struct CalibrationData
 {
-    float midi_note = 12.0f * log2f(freq / 440.0f) + 69.0f; // Convert to MIDI note
-    float root_midi = static_cast<float>(root_note_midi);
-    float closest = root_midi;
+    float readings[kNumCalibrationPoints];
 
-    for (auto note : scales[current_scale_idx])
+    bool operator==(const CalibrationData& rhs) const
     {
-        float candidate = floorf(midi_note / 12.0f) * 12.0f + note + root_midi;
-        if (std::abs(midi_note - candidate) < std::abs(midi_note - closest))
-            closest = candidate;
+        return std::memcmp(readings, rhs.readings, sizeof(readings)) == 0;
     }
+    bool operator!=(const CalibrationData& rhs) const { return !(*this == rhs); }
+};
 
-    // Constrain MIDI note to valid range
-    closest = std::fmax(0.0f, std::fmin(127.0f, closest));
+// Nominal response: 0..1 from the ADC spans 0..5V
+const CalibrationData default_calibration = {{0.2f, 0.4f, 0.6f, 0.8f}};
 
-    return MidiToFrequency(static_cast<int>(closest));
-}
+PersistentStorage<CalibrationData> calibration_storage(patch.seed.qspi);
+CalibrationData calibration_capture = default_calibration;
+size_t calibration_step = 0;
+bool calibration_save_pending = false;
 
-// Update Encoder and Menu Navigation
-void UpdateEncoder()
+// Engine Parameters
+// Everything the engine takes from the UI, as one block. The UI edits
+// `ui_params` and publishes a full copy; the engine picks up the newest one
+// at the top of each block, so a block always runs on one consistent set and
+// never reads UI globals per sample.
+struct EngineParams
+{
+    VoiceMode voice_mode = VoiceMode::OSCILLATORS;
+    float cv_table[kCvTableSize];   // Calibrated reading -> frequency
+    TuningTable tuning;             // Quantizer pitches
+
+    // Oscillator cross-modulation, depth already applied. Only the listed
+    // source rows are evaluated.
+    FmMode fm_mode = FmMode::OFF;
+    uint8_t fm_num_sources = 0;
+    uint8_t fm_sources[kNumFmOperators] = {0};
+    float fm_matrix[kNumFmOperators][kNumFmOperators] = {{0.0f}};
+
+    // Nonlinear stage on the mix
+    ShaperMode shaper_mode = ShaperMode::OFF;
+    uint8_t shaper_factor = 1;
+    float shaper_gain = 2.0f;   // Into the curve, which takes a full-scale mix as +-1
+
+    // Output ladder filter
+    bool filter_on = false;
+    float filter_cutoff = 20000.0f;   // Hz
+    float filter_feedback = 0.0f;     // 0..kFilterMaxFeedback
+
+    // Envelopes, segment times in seconds
+    EnvTrigger env_trigger = EnvTrigger::OFF;
+    EnvelopeShape env_amp = {};
+    EnvelopeShape env_filter = {};
+    float env_cutoff = 0.0f;   // Filter envelope depth, octaves
+    float seq_rate = 2.0f;     // Steps per second
+
+    // Subharmonic divisors, as the modulation matrix left them. The output
+    // gain goes to the engine on its own (SubharmonicEngine::SetLevel).
+    float ratios[kNumSubharmonics] = {2.0f, 3.0f, 4.0f, 5.0f};
+
+    // Additive bank: active partial count and per-partial amplitudes, zero
+    // beyond the count
+    uint8_t num_partials = kDefaultPartials;
+    float partial_amps[kMaxPartials] = {0.0f};
+};
+
+// Triple buffer: the writer and reader each own a slot and the third holds
+// the latest published block. `latest` is that slot's index plus a fresh
+// bit; when nothing new was published the reader's cost is one atomic load.
+template <typename T>
+struct TripleBuffer
 {
-    // Handle Encoder Rising Edge to toggle menu
-    if (patch.encoder.RisingEdge())
+    static constexpr uint8_t kFresh = 0x4;
+
+    T slots[3];
+    std::atomic<uint8_t> latest{1};
+    uint8_t back = 0;    // Writer's slot
+    uint8_t front = 2;   // Reader's slot
+
+    void Init()
     {
-        menu_active = !menu_active; // Toggle menu
-        if (!menu_active)
-            display_mode = DisplayMode::WAVEFORM; // Exit to waveform view
+        latest.store(1, std::memory_order_relaxed);
+        back = 0;
+        front = 2;
     }
 
-    // Read encoder increment once to prevent multiple reads
-    int encoder_increment = patch.encoder.Increment();
+    void Publish(const T& value)
+    {
+        slots[back] = value;
+        back = latest.exchange(static_cast<uint8_t>(back | kFresh), std::memory_order_acq_rel) & 0x3;
+    }
 
-    if (menu_active)
+    ITCM_CODE const T& Acquire()
     {
-        if (encoder_increment > 0)
-        {
-            if (menu_state == MenuState::SCALE_SELECTION)
-            {
-                current_scale_idx = (current_scale_idx + 1) % kNumScales;
-            }
-            else if (menu_state == MenuState::ROOT_NOTE_SELECTION)
-            {
-                root_note_midi = (root_note_midi + 1) % (kNumNotes * kNumOctaves);
-            }
-        }
-        else if (encoder_increment < 0)
-        {
-            if (menu_state == MenuState::SCALE_SELECTION)
-            {
-                current_scale_idx = (current_scale_idx + kNumScales - 1) % kNumScales;
-            }
-            else if (menu_state == MenuState::ROOT_NOTE_SELECTION)
-            {
-                root_note_midi = (root_note_midi + (kNumNotes * kNumOctaves) - 1) % (kNumNotes * kNumOctaves);
-            }
-        }
+        if (latest.load(std::memory_order_relaxed) & kFresh)
+            front = latest.exchange(front, std::memory_order_acq_rel) & 0x3;
+        return slots[front];
+    }
+};
+
+EngineParams ui_params;
+
+// Resonator Bank
+// State-variable band-pass filters (TPT form) tuned to the subharmonics. State
+// and coefficients are stored per-lane so the bank loops vectorize, and the
+// coefficients are only recomputed when the quantized pitch changes.
+struct ResonatorBank
+{
+    float sample_rate = 48000.0f;
+    float tuned_freq  = -1.0f;
+    float k = 1.0f / kResonatorQ;
+    float a1[kNumSubharmonics] = {0.0f};
+    float a2[kNumSubharmonics] = {0.0f};
+    float a3[kNumSubharmonics] = {0.0f};
+    float ic1eq[kNumSubharmonics] = {0.0f};
+    float ic2eq[kNumSubharmonics] = {0.0f};
 
-        // Handle Encoder Press for menu state toggling with debouncing
-        if (patch.encoder.Pressed() && !last_encoder_pressed)
+    void Init(float sr)
+    {
+        sample_rate = sr;
+        tuned_freq  = -1.0f;
+        k = 1.0f / kResonatorQ;
+        for (size_t j = 0; j < kNumSubharmonics; j++)
         {
-            menu_state = (menu_state == MenuState::SCALE_SELECTION) ? MenuState::ROOT_NOTE_SELECTION
-                                                                    : MenuState::SCALE_SELECTION;
-            last_encoder_pressed = true;
+            ic1eq[j] = 0.0f;
+            ic2eq[j] = 0.0f;
         }
-        else if (!patch.encoder.Pressed())
+    }
+
+    // Retune the bank to the subharmonics of freq (no-op if unchanged)
+    ITCM_CODE void SetFreq(float freq, const float* ratios)
+    {
+        if (freq == tuned_freq)
+            return;
+        tuned_freq = freq;
+
+        for (size_t j = 0; j < kNumSubharmonics; j++)
         {
-            last_encoder_pressed = false;
+            float fc = std::fmin(freq / ratios[j], sample_rate * 0.45f);
+            float g  = tanf(PI_F * fc / sample_rate);
+            a1[j] = 1.0f / (1.0f + g * (g + k));
+            a2[j] = g * a1[j];
+            a3[j] = g * a2[j];
         }
     }
-    else
+
+    // Excite the bank with one input sample, even/odd resonators go left/right
+    ITCM_CODE void Process(float in, float& out_l, float& out_r)
     {
-        if (encoder_increment != 0)
+        float bp[kNumSubharmonics];
+
+        for (size_t j = 0; j < kNumSubharmonics; j++)
+        {
+            float v3 = in - ic2eq[j];
+            float v1 = a1[j] * ic1eq[j] + a2[j] * v3;
+            float v2 = ic2eq[j] + a2[j] * ic1eq[j] + a3[j] * v3;
+            ic1eq[j] = 2.0f * v1 - ic1eq[j];
+            ic2eq[j] = 2.0f * v2 - ic2eq[j];
+            bp[j] = k * v1; // Unity gain at the resonant peak
+        }
+
+        for (size_t j = 0; j < kNumSubharmonics; j++)
         {
-            // Toggle between Waveform and XY View
-            display_mode = (display_mode == DisplayMode::WAVEFORM) ? DisplayMode::XY : DisplayMode::WAVEFORM;
+            if (j % 2 == 0)
+                out_l += bp[j];
+            else
+                out_r += bp[j];
         }
     }
-}
+};
 
-// Display: Update Screen
-void UpdateDisplay()
+// Additive Undertone Bank
+// Quadrature recursive oscillators for partials freq / n, n = 1..N. Each
+// partial is a unit phasor rotated by a fixed complex step per sample, which
+// costs four multiplies instead of a sinf. The rotation steps are recomputed
+// only when the quantized pitch changes, and the magnitude drift from rounding
+// is removed by a first-order renormalization once per block. The partial
+// count and amplitudes come from the parameter block at block rate, and each
+// amplitude ramps linearly across the block; partials dropped from the count
+// ramp out over one block before they stop being computed.
+struct AdditiveBank
 {
-    patch.display.Fill(false);
+    float sample_rate = 48000.0f;
+    float tuned_freq  = -1.0f;
+    size_t num_partials = 0;    // Partials computed this block
+    size_t last_count = 0;      // Count from the previous parameter block
+    float re[kMaxPartials] = {0.0f};
+    float im[kMaxPartials] = {0.0f};
+    float rot_re[kMaxPartials] = {0.0f};
+    float rot_im[kMaxPartials] = {0.0f};
+    float amp[kMaxPartials] = {0.0f};
+    float amp_target[kMaxPartials] = {0.0f};
+    float amp_step[kMaxPartials] = {0.0f};
 
-    if (menu_active)
+    // Partials start silent and ramp in over the first block
+    void Init(float sr)
     {
-        patch.display.SetCursor(0, 0);
-        patch.display.WriteString("Menu:", Font_7x10, true);
+        sample_rate = sr;
+        tuned_freq  = -1.0f;
+        num_partials = 0;
+        last_count = 0;
 
-        patch.display.SetCursor(0, 15);
-        if (menu_state == MenuState::SCALE_SELECTION)
+        for (size_t j = 0; j < kMaxPartials; j++)
         {
-            std::string scale_name = scale_names[current_scale_idx];
-            patch.display.WriteString("Scale: ", Font_7x10, false);
-            patch.display.WriteString(scale_name.c_str(), Font_7x10, true);
+            re[j] = 1.0f;
+            im[j] = 0.0f;
+            amp_target[j] = 0.0f;
+            amp[j] = 0.0f;
+            amp_step[j] = 0.0f;
         }
-        else if (menu_state == MenuState::ROOT_NOTE_SELECTION)
+    }
+
+    // Recompute rotation steps for the undertones of freq (no-op if unchanged)
+    ITCM_CODE void SetFreq(float freq)
+    {
+        if (freq == tuned_freq)
+            return;
+        tuned_freq = freq;
+
+        for (size_t j = 0; j < kMaxPartials; j++)
         {
-            int note_idx = root_note_midi % kNumNotes;
-            int octave = root_note_midi / kNumNotes;
-            char buf[32];
-            std::snprintf(buf, sizeof(buf), "Root: %s%d", note_labels[note_idx].c_str(), octave);
-            patch.display.WriteString(buf, Font_7x10, true);
+            float w = TWOPI_F * freq / (static_cast<float>(j + 1) * sample_rate);
+            rot_re[j] = cosf(w);
+            rot_im[j] = sinf(w);
         }
     }
-    else if (display_mode == DisplayMode::WAVEFORM)
+
+    // Call once at the start of each audio block with its parameter block
+    ITCM_CODE void BeginBlock(const EngineParams& p, size_t size)
     {
-        for (size_t i = 1; i < kWaveformBufferSize; i++)
+        size_t count = std::max(kMinPartials, std::min<size_t>(p.num_partials, kMaxPartials));
+        num_partials = std::max(count, last_count);
+        last_count = count;
+
+        float inv_size = 1.0f / static_cast<float>(size);
+        for (size_t j = 0; j < kMaxPartials; j++)
         {
-            int x1 = static_cast<int>((i - 1) * (patch.display.Width() / kWaveformBufferSize));
-            int y1 = static_cast<int>((osc_buffer_l[i - 1] * 20.0f) + 32.0f);
-            int x2 = static_cast<int>(i * (patch.display.Width() / kWaveformBufferSize));
-            int y2 = static_cast<int>((osc_buffer_l[i] * 20.0f) + 32.0f);
-            patch.display.DrawLine(x1, y1, x2, y2, true);
+            float g = 1.5f - 0.5f * (re[j] * re[j] + im[j] * im[j]);
+            re[j] *= g;
+            im[j] *= g;
+
+            // Partials past both counts are idle at zero, so they ramp in
+            // from silence when the count grows
+            if (j >= num_partials)
+                amp[j] = 0.0f;
+            amp_target[j] = (j < count) ? p.partial_amps[j] : 0.0f;
+            amp_step[j] = (amp_target[j] - amp[j]) * inv_size;
         }
     }
-    else if (display_mode == DisplayMode::XY)
+
+    // Advance all partials by one sample, even/odd partials go left/right
+    ITCM_CODE void Process(float& out_l, float& out_r)
     {
-        for (size_t i = 0; i < kWaveformBufferSize; i++)
+        float sig[kMaxPartials];
+
+        for (size_t j = 0; j < num_partials; j++)
         {
-            int x = static_cast<int>((osc_buffer_l[i] * 20.0f) + 64.0f);
-            int y = static_cast<int>((osc_buffer_r[i] * 20.0f) + 32.0f);
-            patch.display.DrawPixel(x, y, true);
+            float r = re[j] * rot_re[j] - im[j] * rot_im[j];
+            float q = re[j] * rot_im[j] + im[j] * rot_re[j];
+            re[j] = r;
+            im[j] = q;
+            amp[j] += amp_step[j];
+            sig[j] = amp[j] * q;
         }
+
+        for (size_t j = 0; j < num_partials; j += 2)
+            out_l += sig[j];
+        for (size_t j = 1; j < num_partials; j += 2)
+            out_r += sig[j];
     }
+};
 
-    patch.display.Update();
+// Helper: Fractional part of x, for x > -1024. Truncating after an offset
+// floors with no branch or floorf call, so lane loops vectorize. Within about
+// 1e-4 of an integer the result may land just outside 0..1, which is harmless
+// to periodic callers.
+ITCM_CODE inline float WrapCycle(float x)
+{
+    return x - static_cast<float>(static_cast<int32_t>(x + 1024.0f) - 1024);
 }
 
-// Audio Callback
-void AudioCallback(AudioHandle::InputBuffer in, AudioHandle::OutputBuffer out, size_t size)
+// Helper: sin(2*pi*x) for x in cycles, x > -1024. The argument is folded into
+// a quarter period and a 7th-order minimax polynomial gives 6e-7 peak error
+// with no table or branch.
+ITCM_CODE inline float SinCycle(float x)
+{
+    float t = WrapCycle(x + 0.5f) - 0.5f;                  // -0.5..0.5
+    float a = 0.25f - std::fabs(std::fabs(t) - 0.25f);      // sin(pi - x) = sin(x)
+    float z = TWOPI_F * std::copysign(a, t);
+    float z2 = z * z;
+    return z * (0.99999661f + z2 * (-0.16664824f + z2 * (0.00830629f - z2 * 0.00018363f)));
+}
+
+// Sine Operator Bank
+// Phase accumulators for the master sine and the subharmonics, run as lanes
+// of one loop. Each sample the routing matrix mixes the operators' previous
+// outputs into a modulation value per lane, one vectorized row per active
+// source, so the cost is fixed per route source and the matrix may feed back.
+// In PM mode that value offsets the read phase; in TZFM mode it scales the
+// phase increment, which may go negative and run the phase backwards.
+struct SineBank
 {
-    for (size_t i = 0; i < size; i++)
+    float sample_rate = 48000.0f;
+    float tuned_freq  = -1.0f;
+    float phase[kNumFmOperators] = {0.0f};
+    float inc[kNumFmOperators] = {0.0f};
+    float out[kNumFmOperators] = {0.0f};   // Last output per operator, the modulation sources
+
+    void Init(float sr)
     {
-        // Process Pitch CV from control
-        float pitch_cv = patch.controls[CTRL_PITCH].Process();
-        float freq = Quantize(20.0f + pitch_cv * 1980.0f);
+        sample_rate = sr;
+        tuned_freq  = -1.0f;
+        for (size_t j = 0; j < kNumFmOperators; j++)
+        {
+            phase[j] = 0.0f;
+            inc[j] = 0.0f;
+            out[j] = 0.0f;
+        }
+    }
 
-        float mix_l = 0.0f, mix_r = 0.0f;
+    // Retune to freq and its subharmonics (no-op if unchanged)
+    ITCM_CODE void SetFreq(float freq, const float* ratios)
+    {
+        if (freq == tuned_freq)
+            return;
+        tuned_freq = freq;
 
+        inc[0] = freq / sample_rate;
         for (size_t j = 0; j < kNumSubharmonics; j++)
-        {
-            subharmonics[j].SetFreq(freq / subharmonic_ratios[j]);
-            float sig = subharmonics[j].Process();
+            inc[j + 1] = freq / (ratios[j] * sample_rate);
+    }
 
-            if (j % 2 == 0)
-                mix_l += sig;
-            else
-                mix_r += sig;
+    // Advance every operator by one sample; even/odd subharmonics go
+    // left/right at amplitude 0.5
+    ITCM_CODE void Process(const EngineParams& p, float& out_l, float& out_r)
+    {
+        float mod[kNumFmOperators] = {0.0f};
+        for (size_t k = 0; k < p.fm_num_sources; k++)
+        {
+            const float* row = p.fm_matrix[p.fm_sources[k]];
+            float y = out[p.fm_sources[k]];
+            for (size_t j = 0; j < kNumFmOperators; j++)
+                mod[j] += row[j] * y;
         }
 
-        mix_l *= 0.5f;
-        mix_r *= 0.5f;
-
-        // Store in waveform buffers with thread-safe access if needed
-        osc_buffer_l[buffer_index] = mix_l;
-        osc_buffer_r[buffer_index] = mix_r;
-        buffer_index = (buffer_index + 1) % kWaveformBufferSize;
+        const float pm = (p.fm_mode == FmMode::PM) ? 1.0f : 0.0f;
+        const float fm = (p.fm_mode == FmMode::TZFM) ? 1.0f : 0.0f;
+        for (size_t j = 0; j < kNumFmOperators; j++)
+        {
+            out[j] = SinCycle(phase[j] + pm * mod[j]);
+            phase[j] += inc[j] * (1.0f + fm * mod[j]);
+            phase[j] = WrapCycle(phase[j]);
+        }
 
-        // Output to audio buffers
-        out[0][i] = mix_l;
-        out[1][i] = mix_r;
+        out_l += 0.5f * (out[1] + out[3]);
+        out_r += 0.5f * (out[2] + out[4]);
     }
-}
+};
 
-int main(void)
+// Half-Band Filters
+// Polyphase IIR half-band lowpass for 2x resampling: two chains of
+// first-order allpasses run at the low rate, each section one multiply, and
+// the filter's output is the average of the chains. Coefficients alternate
+// between the chains. Both stages keep 0..20 kHz flat; the 48 <-> 96 kHz stage
+// rejects 28 kHz and up by 100 dB, the 96 <-> 192 kHz stage 76 kHz and up by
+// 84 dB. Left and right run as two lanes of one filter.
+DTCM_RODATA const float halfband_2x[kHalfBandCoefs2x] = {
+    0.0397135109f, 0.147382413f, 0.295352829f, 0.454002216f,
+    0.602654817f, 0.732671805f, 0.845266875f, 0.948280918f
+};
+DTCM_RODATA const float halfband_4x[kHalfBandCoefs4x] = {
+    0.0618458678f, 0.231494964f, 0.478980557f, 0.798233686f
+};
+
+template <size_t N>
+struct HalfBand
 {
-    // Initialize Patch
-    patch.Init();
+    float x1[N][2];   // Per section and lane
+    float y1[N][2];
 
-    // Initialize Oscillators
-    for (auto& osc : subharmonics)
+    void Init()
     {
-        osc.Init(patch.AudioSampleRate());
-        osc.SetWaveform(Oscillator::WAVE_SIN);
+        for (size_t k = 0; k < N; k++)
+            for (size_t c = 0; c < 2; c++)
+            {
+                x1[k][c] = 0.0f;
+                y1[k][c] = 0.0f;
+            }
+    }
+
+    // Run the even sections over a and the odd ones over b
+    ITCM_CODE void Paths(const float* coefs, float* a, float* b)
+    {
+        for (size_t k = 0; k < N; k += 2)
+        {
+            for (size_t c = 0; c < 2; c++)
+            {
+                float ya = coefs[k] * (a[c] - y1[k][c]) + x1[k][c];
+                x1[k][c] = a[c];
+                y1[k][c] = ya;
+                a[c] = ya;
+
+                float yb = coefs[k + 1] * (b[c] - y1[k + 1][c]) + x1[k + 1][c];
+                x1[k + 1][c] = b[c];
+                y1[k + 1][c] = yb;
+                b[c] = yb;
+            }
+        }
+    }
+
+    // One sample in, two out at twice the rate
+    ITCM_CODE void Upsample(const float* coefs, const float* in, float* out0, float* out1)
+    {
+        for (size_t c = 0; c < 2; c++)
+        {
+            out0[c] = in[c];
+            out1[c] = in[c];
+        }
+        Paths(coefs, out0, out1);
+    }
+
+    // Two samples in, oldest first, one out at half the rate
+    ITCM_CODE void Downsample(const float* coefs, const float* in0, const float* in1, float* out)
+    {
+        float a[2] = {in1[0], in1[1]};
+        float b[2] = {in0[0], in0[1]};
+        Paths(coefs, a, b);
+        for (size_t c = 0; c < 2; c++)
+            out[c] = 0.5f * (a[c] + b[c]);
+    }
+};
+
+// Helper: Rational tanh approximation, exact at 0 and meeting +-1 with zero
+// slope at +-3, with no branch
+ITCM_CODE inline float SoftClip(float x)
+{
+    float c = std::fmax(-3.0f, std::fmin(3.0f, x));
+    float c2 = c * c;
+    return c * (27.0f + c2) / (27.0f + 9.0f * c2);
+}
+
+// Helper: Shaper curves, each taking +-1 to about +-1 with no branch.
+// Folding reflects off +-1 again and again as the drive rises; the
+// asymmetric curve rounds off at +1 and flattens hard at -0.5.
+ITCM_CODE inline float Shape(ShaperMode mode, float x)
+{
+    switch (mode)
+    {
+        case ShaperMode::FOLD:
+            return 1.0f - 2.0f * std::fabs(2.0f * WrapCycle((x + 1.0f) * 0.25f) - 1.0f);
+        case ShaperMode::TANH:
+            return SoftClip(x);
+        case ShaperMode::ASYM:
+        {
+            float pos = std::fmin(std::fmax(x, 0.0f), 1.0f);
+            float neg = std::fmax(std::fmin(x, 0.0f), -0.5f);
+            return 1.5f * pos * (1.0f - pos * pos * (1.0f / 3.0f)) + neg;
+        }
+        default:
+            return x;
+    }
+}
+
+// Waveshaper
+// Nonlinear stage on the stereo mix. The curve's harmonics reach far past
+// Nyquist, so at 2x or 4x the mix is upsampled through the half-band stages,
+// shaped, and brought back down through them, which filters out what would
+// otherwise fold back as inharmonic aliases. host/oversampling_bench.cpp
+// measures what each factor removes and costs. The filters restart when the
+// factor changes and when the shaper comes out of bypass, so history from
+// before it was switched off doesn't click in.
+struct Waveshaper
+{
+    HalfBand<kHalfBandCoefs2x> up_2x, down_2x;
+    HalfBand<kHalfBandCoefs4x> up_4x, down_4x;
+    uint8_t factor = 1;
+    bool active = false;   // False while bypassed
+
+    void Init()
+    {
+        up_2x.Init();
+        down_2x.Init();
+        up_4x.Init();
+        down_4x.Init();
+        factor = 1;
+    }
+
+    void Bypass()
+    {
+        active = false;
+    }
+
+    ITCM_CODE void Process(const EngineParams& p, float& out_l, float& out_r)
+    {
+        if (!active || p.shaper_factor != factor)
+        {
+            Init();
+            factor = p.shaper_factor;
+            active = true;
+        }
+
+        const float x[2] = {p.shaper_gain * out_l, p.shaper_gain * out_r};
+        float s[kMaxOversampling][2];
+        float half[2][2];
+        if (factor == 1)
+        {
+            s[0][0] = x[0];
+            s[0][1] = x[1];
+        }
+        else
+        {
+            up_2x.Upsample(halfband_2x, x, half[0], half[1]);
+            if (factor == 2)
+            {
+                std::memcpy(s, half, sizeof(half));
+            }
+            else
+            {
+                up_4x.Upsample(halfband_4x, half[0], s[0], s[1]);
+                up_4x.Upsample(halfband_4x, half[1], s[2], s[3]);
+            }
+        }
+
+        for (size_t i = 0; i < factor; i++)
+            for (size_t c = 0; c < 2; c++)
+                s[i][c] = Shape(p.shaper_mode, s[i][c]);
+
+        float y[2];
+        if (factor == 1)
+        {
+            y[0] = s[0][0];
+            y[1] = s[0][1];
+        }
+        else
+        {
+            if (factor == 4)
+            {
+                down_4x.Downsample(halfband_4x, s[0], s[1], half[0]);
+                down_4x.Downsample(halfband_4x, s[2], s[3], half[1]);
+            }
+            else
+            {
+                std::memcpy(half, s, sizeof(half));
+            }
+            down_2x.Downsample(halfband_2x, half[0], half[1], y);
+        }
+
+        out_l = 0.5f * y[0];
+        out_r = 0.5f * y[1];
+    }
+};
+
+// Seqlock
+// Single-writer snapshot for handing values from the audio callback to the
+// UI. The writer makes the sequence odd while it copies; readers retry if the
+// sequence was odd or moved during their copy, so they never see a torn value
+// and the writer never waits.
+template <typename T>
+struct Seqlock
+{
+    std::atomic<uint32_t> sequence{0};
+    T data;
+    mutable uint32_t read_retries = 0;   // Reader-side contention count
+
+    ITCM_CODE void Write(const T& value)
+    {
+        uint32_t seq = sequence.load(std::memory_order_relaxed);
+        sequence.store(seq + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        std::memcpy(&data, &value, sizeof(T));
+        std::atomic_thread_fence(std::memory_order_release);
+        sequence.store(seq + 2, std::memory_order_relaxed);
+    }
+
+    T Read() const
+    {
+        T value;
+        while (true)
+        {
+            uint32_t before = sequence.load(std::memory_order_acquire);
+            std::memcpy(&value, &data, sizeof(T));
+            std::atomic_thread_fence(std::memory_order_acquire);
+            uint32_t after = sequence.load(std::memory_order_relaxed);
+            if ((before & 1) == 0 && before == after)
+                return value;
+            read_retries++;
+        }
+    }
+};
+
+// Tuner Readout
+// Published by the engine once per block
+struct TunerSnapshot
+{
+    float input_freq;
+    float quantized_freq;
+    float sub_freqs[kNumSubharmonics];
+    float ratios[kNumSubharmonics];
+};
+
+// Formatted tuner lines, rebuilt only when the rounded value they show changes
+struct TunerText
+{
+    int note = -1;
+    int note_cents = 0;
+    int cv_cents = 0;
+    int sub_tenths[kNumSubharmonics] = {-1, -1, -1, -1};
+    char note_line[32] = "";
+    char cv_line[32] = "";
+    char sub_lines[kNumSubharmonics / 2][32] = {"", ""};
+};
+
+TunerText tuner_text;
+
+// Scope Capture
+// Rising-edge triggered capture of the left mix with a timebase decimated to
+// show kScopeCycles periods of the lowest subharmonic. Each bucket keeps the
+// min and max of the samples it spans, so the shape survives decimation. The
+// audio side owns the capture arrays until a trace is READY; the UI then
+// copies it out and re-arms.
+struct ScopeCapture
+{
+    enum class State : uint8_t
+    {
+        ARMED,
+        CAPTURING,
+        READY
+    };
+
+    std::atomic<State> state{State::ARMED};
+    float sample_rate = 48000.0f;
+    uint32_t decimation = 1;
+    uint32_t next_decimation = 1;
+    uint32_t count = 0;
+    uint32_t waited = 0;
+    size_t bucket = 0;
+    bool below = false;
+    float lo = 0.0f, hi = 0.0f;
+    float capture_min[kScopeBuckets] = {0.0f};
+    float capture_max[kScopeBuckets] = {0.0f};
+
+    void Init(float sr)
+    {
+        sample_rate = sr;
+        decimation = next_decimation = 1;
+        count = waited = 0;
+        bucket = 0;
+        below = false;
+        lo = hi = 0.0f;
+        state.store(State::ARMED, std::memory_order_relaxed);
+    }
+
+    // Match the timebase to the lowest subharmonic, at lowest Hz; takes
+    // effect at the next trigger so a trace never changes scale halfway through
+    void SetLowest(float lowest)
+    {
+        float samples = kScopeCycles * sample_rate / std::fmax(lowest, 1.0f);
+        next_decimation = std::max<uint32_t>(1, static_cast<uint32_t>(samples / kScopeBuckets));
+    }
+
+    ITCM_CODE inline void Process(float x)
+    {
+        State s = state.load(std::memory_order_relaxed);
+        if (s == State::CAPTURING)
+        {
+            lo = std::fmin(lo, x);
+            hi = std::fmax(hi, x);
+            if (++count == decimation)
+            {
+                capture_min[bucket] = lo;
+                capture_max[bucket] = hi;
+                count = 0;
+                lo = hi = x;
+                if (++bucket == kScopeBuckets)
+                    state.store(State::READY, std::memory_order_release);
+            }
+        }
+        else if (s == State::ARMED)
+        {
+            if (x < -kScopeHysteresis)
+                below = true;
+            if ((below && x >= 0.0f) || ++waited >= kScopeAutoTrigger)
+            {
+                decimation = next_decimation;
+                bucket = 0;
+                count = 0;
+                waited = 0;
+                below = false;
+                lo = hi = x;
+                state.store(State::CAPTURING, std::memory_order_relaxed);
+            }
+        }
+    }
+};
+
+std::array<float, kScopeBuckets> scope_min = {0.0f};
+std::array<float, kScopeBuckets> scope_max = {0.0f};
+
+// Phosphor Buffer
+// 8-bit intensity per OLED pixel for the persistence XY view. Rows are word
+// aligned so decay can work on four pixels per 32-bit operation.
+alignas(4) uint8_t phosphor[kDisplayHeight][kDisplayWidth] = {{0}};
+
+// 4x4 ordered-dither thresholds, spread over 8..248
+const uint8_t phosphor_dither[4][4] = {
+    {8, 136, 40, 168},
+    {200, 72, 232, 104},
+    {56, 184, 24, 152},
+    {248, 120, 216, 88}
+};
+
+// Encoder Events
+// A 1 kHz timer interrupt debounces the encoder and queues each detent and
+// press edge with its capture time, so turns made while the main loop is
+// busy drawing are kept and velocity comes from when they happened.
+constexpr uint32_t kEncoderTickHz = 1000;
+constexpr size_t kEncoderQueueSize = 64;        // Power of two
+constexpr uint32_t kAccelSlowUs = 60000;        // Detent spacing below which turns speed up
+constexpr uint32_t kAccelFastUs = 8000;         // Detent spacing that gives the full step
+constexpr int kAccelMaxStep = 12;               // Steps per detent at full speed
+
+enum class EncoderEventKind : uint8_t
+{
+    TURN,
+    PRESS,
+    RELEASE
+};
+
+struct EncoderEvent
+{
+    uint32_t time_us;
+    EncoderEventKind kind;
+    int8_t delta;   // Detents, TURN only
+};
+
+// Single-producer, single-consumer ring. The ISR pushes, the main loop pops;
+// a full queue drops the new event rather than block the interrupt.
+template <typename T, size_t N>
+struct EventQueue
+{
+    static_assert((N & (N - 1)) == 0, "EventQueue size must be a power of two");
+
+    std::atomic<uint32_t> head{0};   // Written by the producer
+    std::atomic<uint32_t> tail{0};   // Written by the consumer
+    uint32_t dropped = 0;
+    T slots[N];
+
+    bool Push(const T& event)
+    {
+        uint32_t h = head.load(std::memory_order_relaxed);
+        if (h - tail.load(std::memory_order_acquire) == N)
+        {
+            dropped++;
+            return false;
+        }
+        slots[h & (N - 1)] = event;
+        head.store(h + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool Pop(T& event)
+    {
+        uint32_t t = tail.load(std::memory_order_relaxed);
+        if (t == head.load(std::memory_order_acquire))
+            return false;
+        event = slots[t & (N - 1)];
+        tail.store(t + 1, std::memory_order_release);
+        return true;
+    }
+};
+
+EventQueue<EncoderEvent, kEncoderQueueSize> encoder_events;
+TimerHandle encoder_timer;
+
+// Acceleration state, main loop only
+uint32_t last_turn_us = 0;
+int last_turn_dir = 0;
+
+// UI State
+DisplayMode display_mode = DisplayMode::WAVEFORM;
+MenuState menu_state = MenuState::SCALE_SELECTION;
+bool menu_active = false;
+
+// Main-Loop Scheduler
+// Cooperative tasks with a period and a time budget each. RunScheduler()
+// runs whichever are due; the render task spreads a frame over several
+// passes so encoder input never waits behind a whole frame.
+constexpr size_t kNumTasks = 6;
+
+struct Task
+{
+    const char* name;
+    void (*run)(uint32_t budget_us);
+    uint32_t period_us;   // 0 runs on every pass
+    uint32_t budget_us;
+    uint32_t next_us = 0;
+    uint32_t worst_us = 0;
+    uint32_t overruns = 0;
+};
+
+extern Task tasks[kNumTasks];
+
+// Input-to-screen latency: from an encoder edge being captured to the end of
+// the first frame flush that includes it
+bool input_pending = false;
+uint32_t input_pending_us = 0;
+uint32_t last_frame_us = 0;
+uint32_t ui_latency_last_us = 0;
+uint32_t ui_latency_worst_us = 0;
+
+// Control Recorder
+// Logs pitch CV, CV 2-4, gate 1 and encoder input with sample timestamps into
+// SDRAM so a live session can be saved to the SD card and replayed on the host
+// (host/replay.cpp). Pitch and CV 2-4 are logged only when their 16-bit value
+// moves more than kRecorderDeadband from the last value logged, so ADC noise
+// on a held CV doesn't fill the buffer, and the gate, read once per block,
+// only when it changes state. The
+// audio callback, the control task and the encoder interrupt all append, each
+// claiming a slot with one atomic add. Recording stops when the buffer fills
+// rather than wrapping, since replay has to start from the UI state in the
+// header.
+constexpr size_t kRecorderCapacity = 1 << 21;   // Records (16 MB)
+constexpr size_t kRecorderSaveChunk = 8192;     // Records written per storage pass (64 KB)
+constexpr uint32_t kRecorderNoPitch = 0x10000;  // Forces the first pitch record
+constexpr uint32_t kRecorderDeadband = 8;       // 16-bit steps a CV must move to be logged, 0.7 cents at 1 V/oct
+constexpr uint16_t kSessionVersion = 7;
+
+enum class ControlKind : uint8_t
+{
+    PITCH,
+    TURN,
+    PRESS,
+    RELEASE,
+    GATE,
+    CV
+};
+
+struct ControlRecord
+{
+    uint32_t sample;    // Sample clock
+    uint16_t value;     // PITCH, CV: reading * 65535; GATE: 1 when high
+    ControlKind kind;
+    int8_t delta;       // TURN: detents; CV: 0..2 for CV 2-4
+};
+
+// File header; the UI state is what the session started from
+struct SessionHeader
+{
+    char magic[4];      // "SHRC"
+    uint16_t version;
+    uint16_t record_size;
+    uint32_t sample_rate;
+    uint32_t block_size;
+    uint32_t first_sample;
+    uint32_t num_records;
+    int32_t root_note_midi;
+    uint8_t scale;
+    uint8_t tuning;
+    uint8_t voice_mode;
+    uint8_t menu_state;
+    uint8_t menu_active;
+    uint8_t display_mode;
+    uint8_t fm_preset;
+    uint8_t fm_depth;           // Percent
+    uint8_t shaper_preset;
+    uint8_t shaper_drive;       // Percent
+    uint8_t filter_cutoff;      // Cutoff page step
+    uint8_t filter_resonance;   // Percent
+    uint8_t env_preset;
+    uint8_t env_time;           // Time page step
+    uint8_t env_cutoff;         // Tenths of an octave
+    uint8_t mod_preset;
+    uint8_t mod_depth;          // Percent
+    uint8_t lfo_rate;           // LFO page step
+    uint16_t seq_bpm;
+    uint8_t partials;           // Additive partial count
+};
+
+enum class RecorderState : uint8_t
+{
+    IDLE,
+    RECORDING,
+    SAVING,
+    SAVED,
+    FAILED
+};
+
+DSY_SDRAM_BSS ControlRecord session_records[kRecorderCapacity];
+
+struct ControlRecorder
+{
+    std::atomic<bool> recording{false};
+    std::atomic<uint32_t> count{0};
+    uint32_t last_pitch = kRecorderNoPitch;   // Audio callback only
+    uint8_t last_gate = 2;                     // Audio callback only; 2 forces the first record
+    uint32_t last_cv[3] = {kRecorderNoPitch, kRecorderNoPitch, kRecorderNoPitch};   // Control task only
+
+    // Main loop only
+    RecorderState state = RecorderState::IDLE;
+    SessionHeader header;
+    uint32_t saved = 0;
+    bool file_open = false;
+
+    // Append one record; safe from the audio callback and the encoder interrupt
+    ITCM_CODE void Record(uint32_t sample, ControlKind kind, uint16_t value, int8_t delta)
+    {
+        uint32_t slot = count.fetch_add(1, std::memory_order_relaxed);
+        if (slot < kRecorderCapacity)
+            session_records[slot] = {sample, value, kind, delta};
+    }
+
+    uint32_t Size() const { return std::min<uint32_t>(count.load(std::memory_order_relaxed), kRecorderCapacity); }
+
+    // A 16-bit reading has left the deadband around the last one logged
+    static inline bool Moved(uint32_t value, uint32_t last)
+    {
+        return last == kRecorderNoPitch || (value > last ? value - last : last - value) > kRecorderDeadband;
+    }
+};
+
+ControlRecorder recorder;
+FIL session_file;
+
+// Sample clock, advanced by the audio callback at the end of each block
+DTCM_MEM_SECTION std::atomic<uint32_t> sample_clock{0};
+
+// Flight Recorder
+// Wait-free trace ring that the audio callback and the UI write compact
+// events into, so there is a history to look at after a glitch. A trace
+// point is one atomic add and two word stores; the ring keeps the newest
+// kTraceSize events. A dump snapshots the ring and writes it to trace.bin
+// on the SD card, or over the USB serial log without one. The first audio
+// overrun triggers one automatically; a manual dump from the Trace page
+// re-arms that. host/trace_decode.cpp turns either form into a timeline.
+constexpr size_t kTraceSize = 4096;             // Events, power of two
+constexpr size_t kTraceDumpChunk = 1024;        // Events written to SD per storage pass
+constexpr size_t kTraceSerialChunk = 32;        // Lines printed per storage pass
+constexpr uint16_t kTraceVersion = 1;
+
+enum class TraceType : uint8_t
+{
+    BLOCK_START,    // arg16: block size
+    BLOCK_END,
+    NOTE,           // arg16: quantized frequency, quarter Hz
+    AUDIO_OVERRUN,  // arg16: block time as percent of the block period
+    SCALE,          // arg8: scale index
+    ROOT,           // arg16: root MIDI note
+    TUNING,         // arg8: tuning index
+    VOICE_MODE,     // arg8: voice mode
+    TASK_OVERRUN,   // arg8: task index, arg16: run time in us
+    DUMP,           // arg16: 1 when triggered by an overrun
+    FM,             // arg8: FM preset, arg16: depth percent
+    SHAPER,         // arg8: shaper preset, arg16: drive percent
+    FILTER,         // arg8: cutoff step, arg16: resonance percent
+    ENVELOPE,       // arg8: envelope preset, arg16: time step | cutoff tenths << 8
+    SEQ_RATE,       // arg16: BPM
+    MOD,            // arg8: modulation preset, arg16: depth percent | LFO step << 8
+    PARTIALS        // arg8: additive partial count
+};
+
+// Packed as two words: tick, then type | arg8 << 8 | arg16 << 16
+struct TraceEvent
+{
+    uint32_t tick;
+    uint32_t info;
+};
+
+struct TraceHeader
+{
+    char magic[4];      // "SHTR"
+    uint16_t version;
+    uint16_t event_size;
+    uint32_t tick_freq;
+    uint32_t block_ticks;   // Audio block period
+    uint32_t num_events;    // Oldest first
+};
+
+enum class TraceDumpState : uint8_t
+{
+    IDLE,
+    WRITING,
+    DONE,
+    FAILED
+};
+
+TraceEvent trace_ring[kTraceSize];
+std::atomic<uint32_t> trace_head{0};
+
+ITCM_CODE inline void TracePoint(TraceType type, uint8_t arg8 = 0, uint16_t arg16 = 0)
+{
+    uint32_t slot = trace_head.fetch_add(1, std::memory_order_relaxed) & (kTraceSize - 1);
+    trace_ring[slot].tick = System::GetTick();
+    trace_ring[slot].info = static_cast<uint32_t>(type) | (uint32_t(arg8) << 8) | (uint32_t(arg16) << 16);
+}
+
+struct TraceDump
+{
+    TraceDumpState state = TraceDumpState::IDLE;
+    TraceHeader header;
+    TraceEvent events[kTraceSize];
+    uint32_t written = 0;
+    bool to_sd = false;
+    bool file_open = false;
+    bool requested = false;
+};
+
+TraceDump trace_dump;
+FIL trace_file;
+DTCM_MEM_SECTION uint32_t trace_block_ticks;
+DTCM_MEM_SECTION std::atomic<uint32_t> audio_overruns{0};
+uint32_t audio_overruns_seen = 0;
+bool trace_auto_armed = true;
+
+// Fast Pitch Math
+// Polynomial exp2/log2 used for every pitch conversion in place of powf and
+// log2f. Both split the argument into exponent and mantissa and evaluate a
+// minimax fit over one octave. Worst-case error is 0.005 cents for FastExp2
+// over [-126, 127] and 0.027 cents for FastLog2 over normal positive floats;
+// of the latter, 0.018 is the fit and the rest is float rounding of the sum at
+// large exponents. host/fast_math_test.cpp checks both exhaustively.
+inline float FastLog2(float x)
+{
+    uint32_t bits;
+    std::memcpy(&bits, &x, sizeof(bits));
+    float exponent = static_cast<float>(static_cast<int32_t>((bits >> 23) & 0xFF) - 127);
+    bits = (bits & 0x007FFFFFu) | 0x3F800000u;
+
+    float mantissa;
+    std::memcpy(&mantissa, &bits, sizeof(mantissa));
+    float t = mantissa - 1.0f;
+
+    return exponent
+           + t * (1.4419656f + t * (-0.7096628f + t * (0.41759562f + t * (-0.19626941f + t * 0.046385258f))));
+}
+
+ITCM_CODE inline float FastExp2(float x)
+{
+    x = std::fmax(-126.0f, std::fmin(127.0f, x));
+    float whole = floorf(x);
+    float f = x - whole;
+    float p = 1.0000026f + f * (0.69300383f + f * (0.24144275f + f * (0.052011453f + f * 0.013534173f)));
+
+    uint32_t bits;
+    std::memcpy(&bits, &p, sizeof(bits));
+    bits += static_cast<uint32_t>(static_cast<int32_t>(whole)) << 23;
+    std::memcpy(&p, &bits, sizeof(p));
+    return p;
+}
+
+// Helper: Convert MIDI note to frequency
+float MidiToFrequency(int midi_note)
+{
+    return 440.0f * FastExp2((midi_note - 69) / 12.0f);
+}
+
+// Helper: Check that readings rise with voltage, as the table builder needs
+bool CalibrationValid(const CalibrationData& cal)
+{
+    for (size_t k = 0; k < kNumCalibrationPoints; k++)
+    {
+        if (!(cal.readings[k] > 0.0f && cal.readings[k] < 1.0f))
+            return false;
+        if (k > 0 && cal.readings[k] - cal.readings[k - 1] < 0.01f)
+            return false;
+    }
+    return true;
+}
+
+// Helper: Expand calibration points into a reading -> frequency table
+void BuildCvTable(const CalibrationData& cal, float* table)
+{
+    for (size_t i = 0; i < kCvTableSize; i++)
+    {
+        float reading = static_cast<float>(i) / static_cast<float>(kCvTableSize - 1);
+
+        // Piecewise-linear reading -> volts, extrapolating the end segments
+        size_t seg = 0;
+        while (seg < kNumCalibrationPoints - 2 && reading > cal.readings[seg + 1])
+            seg++;
+        float slope = (calibration_volts[seg + 1] - calibration_volts[seg])
+                      / (cal.readings[seg + 1] - cal.readings[seg]);
+        float volts = calibration_volts[seg] + (reading - cal.readings[seg]) * slope;
+
+        table[i] = kCvBaseFrequency * FastExp2(volts);
+    }
+}
+
+// Helper: Convert a raw pitch CV reading (0..1) to frequency, 1V/oct
+ITCM_CODE inline float CvToFrequency(const float* table, float reading)
+{
+    float pos = std::fmax(0.0f, std::fmin(1.0f, reading)) * static_cast<float>(kCvTableSize - 1);
+    size_t idx = std::min(static_cast<size_t>(pos), kCvTableSize - 2);
+    float frac = pos - static_cast<float>(idx);
+    return table[idx] + (table[idx + 1] - table[idx]) * frac;
+}
+
+// Helper: Copy the next line of text, returning the position after it
+const char* NextLine(const char* pos, const char* end, char* line, size_t line_size)
+{
+    size_t len = 0;
+    while (pos < end && *pos != '\n')
+    {
+        if (*pos != '\r' && len + 1 < line_size)
+            line[len++] = *pos;
+        pos++;
+    }
+    line[len] = '\0';
+    return (pos < end) ? pos + 1 : end;
+}
+
+// Helper: Next non-comment line of a Scala file, or nullptr at the end
+const char* NextScalaLine(const char* pos, const char* end, char* line, size_t line_size)
+{
+    while (pos < end)
+    {
+        pos = NextLine(pos, end, line, line_size);
+        if (line[0] != '!')
+            return pos;
+    }
+    return nullptr;
+}
+
+// Helper: Parse a Scala pitch ("701.955" cents, "3/2" or "2" ratios) as a
+// ratio; one that overflows or underflows to infinity or zero is malformed
+bool ParseScalaPitch(const char* text, float& ratio)
+{
+    while (*text == ' ' || *text == '\t')
+        text++;
+
+    const char* token_end = text;
+    bool is_cents = false;
+    while (*token_end != '\0' && *token_end != ' ' && *token_end != '\t')
+    {
+        if (*token_end == '.')
+            is_cents = true;
+        token_end++;
+    }
+
+    char* parse_end = nullptr;
+    if (is_cents)
+    {
+        float cents = std::strtof(text, &parse_end);
+        if (parse_end == text)
+            return false;
+        ratio = exp2f(cents / 1200.0f);
+        return std::isfinite(ratio) && ratio > 0.0f;
+    }
+
+    long num = std::strtol(text, &parse_end, 10);
+    if (parse_end == text || num <= 0)
+        return false;
+    long den = 1;
+    if (*parse_end == '/')
+    {
+        den = std::strtol(parse_end + 1, &parse_end, 10);
+        if (den <= 0)
+            return false;
+    }
+    ratio = static_cast<float>(num) / static_cast<float>(den);
+    return std::isfinite(ratio) && ratio > 0.0f;
+}
+
+// Helper: Parse a Scala .scl file held in memory
+bool ParseScalaScale(const char* text, size_t len, ScalaTuning& tuning)
+{
+    const char* end = text + len;
+    char line[96];
+
+    // Description line, then the degree count
+    const char* pos = NextScalaLine(text, end, line, sizeof(line));
+    if (pos == nullptr || (pos = NextScalaLine(pos, end, line, sizeof(line))) == nullptr)
+        return false;
+    long count = std::strtol(line, nullptr, 10);
+    if (count <= 0 || count > static_cast<long>(kMaxTuningDegrees))
+        return false;
+
+    // The implicit 1/1 is degree 0; the last listed pitch is the period
+    float ratios[kMaxTuningDegrees];
+    float period = 0.0f;
+    ratios[0] = 1.0f;
+    for (long k = 1; k <= count; k++)
+    {
+        float ratio;
+        pos = NextScalaLine(pos, end, line, sizeof(line));
+        if (pos == nullptr || !ParseScalaPitch(line, ratio))
+            return false;
+        if (k == count)
+            period = ratio;
+        else
+            ratios[k] = ratio;
+    }
+    if (period <= 1.0f)
+        return false;
+
+    tuning.num_degrees = static_cast<size_t>(count);
+    tuning.period = period;
+    std::copy(ratios, ratios + count, tuning.ratios);
+    return true;
+}
+
+// Helper: Parse the reference pitch of a Scala .kbm file held in memory
+bool ParseScalaKeyboardMap(const char* text, size_t len, ScalaTuning& tuning)
+{
+    const char* end = text + len;
+    const char* pos = text;
+    char line[96];
+    long fields[5];
+
+    // Map size, first note, last note, middle note, reference note
+    for (auto& field : fields)
+    {
+        if ((pos = NextScalaLine(pos, end, line, sizeof(line))) == nullptr)
+            return false;
+        field = std::strtol(line, nullptr, 10);
+    }
+    if ((pos = NextScalaLine(pos, end, line, sizeof(line))) == nullptr)
+        return false;
+    float reference_freq = std::strtof(line, nullptr);
+    if (!std::isfinite(reference_freq) || !(reference_freq > 0.0f))
+        return false;
+
+    tuning.has_keyboard_map = true;
+    tuning.middle_note = static_cast<int>(fields[3]);
+    tuning.reference_note = static_cast<int>(fields[4]);
+    tuning.reference_freq = reference_freq;
+    return true;
+}
+
+// Helper: Mount the SD card, returns false if no card is present
+bool MountSdCard()
+{
+    SdmmcHandler::Config sd_cfg;
+    sd_cfg.Defaults();
+    if (sd_card.Init(sd_cfg) != SdmmcHandler::Result::OK)
+        return false;
+    sd_fs.Init(FatFSInterface::Config::MEDIA_SD);
+    return f_mount(&sd_fs.GetSDFileSystem(), "/", 1) == FR_OK;
+}
+
+// Helper: Read a text file from the SD card into scala_text
+size_t ReadSdTextFile(const char* path)
+{
+    if (f_open(&sd_file, path, FA_READ) != FR_OK)
+        return 0;
+    UINT bytes_read = 0;
+    f_read(&sd_file, scala_text, kScalaFileSize - 1, &bytes_read);
+    f_close(&sd_file);
+    scala_text[bytes_read] = '\0';
+    return bytes_read;
+}
+
+// Helper: Load tuning.scl (and optional tuning.kbm) from the SD card root
+bool LoadScalaFromSd()
+{
+    ScalaTuning loaded;
+    size_t len = ReadSdTextFile("tuning.scl");
+    if (len == 0 || !ParseScalaScale(scala_text, len, loaded))
+        return false;
+
+    len = ReadSdTextFile("tuning.kbm");
+    if (len > 0)
+        ParseScalaKeyboardMap(scala_text, len, loaded);
+
+    scala_tuning = loaded;
+    return true;
+}
+
+// Helper: Compile a tuning, scale and root into a quantizer table
+void BuildTuningTable(TuningTable& table, size_t tuning_idx, size_t scale_idx, int root)
+{
+    const TuningSystem& system = tunings[tuning_idx];
+
+    // Collect one period of degrees as ratios above the root
+    float degrees[kMaxTuningDegrees];
+    size_t num_degrees = 0;
+    float period = 2.0f;
+    float root_freq = MidiToFrequency(root);
+
+    if (system.kind == TuningKind::SCALA && scala_tuning.num_degrees > 0)
+    {
+        // Fold degrees into one period so the sorted expansion stays monotonic
+        num_degrees = scala_tuning.num_degrees;
+        period = scala_tuning.period;
+        for (size_t k = 0; k < num_degrees; k++)
+        {
+            float ratio = scala_tuning.ratios[k];
+            while (std::isfinite(ratio) && ratio >= period)
+                ratio /= period;
+            while (ratio > 0.0f && ratio < 1.0f)
+                ratio *= period;
+            degrees[k] = ratio;
+        }
+        std::sort(degrees, degrees + num_degrees);
+
+        // Anchor the scale so the .kbm reference note lands on its frequency
+        if (scala_tuning.has_keyboard_map)
+        {
+            int steps = scala_tuning.reference_note - scala_tuning.middle_note;
+            int n = static_cast<int>(num_degrees);
+            int octaves = (steps >= 0) ? steps / n : -((-steps + n - 1) / n);
+            int degree = steps - octaves * n;
+            root_freq = scala_tuning.reference_freq
+                        / (degrees[degree] * FastExp2(static_cast<float>(octaves) * FastLog2(period)));
+        }
+    }
+    else if (system.kind == TuningKind::JUST_8)
+    {
+        num_degrees = 8;
+        std::copy(ji_8_ratios, ji_8_ratios + num_degrees, degrees);
+    }
+    else if (system.kind != TuningKind::EQUAL || system.divisions == kNumNotes)
+    {
+        // Twelve-note tunings keep only the degrees of the selected scale;
+        // Scala without a loaded file falls back to 12-TET
+        const Scale& scale = scales[scale_idx];
+        for (size_t k = 0; k < scale.size; k++)
+        {
+            size_t semitone = scale.notes[k];
+            degrees[num_degrees++] = (system.kind == TuningKind::JUST_12)
+                                         ? ji_12_ratios[semitone]
+                                         : FastExp2(static_cast<float>(semitone) / 12.0f);
+        }
+    }
+    else
+    {
+        for (size_t k = 0; k < system.divisions; k++)
+            degrees[num_degrees++] = FastExp2(static_cast<float>(k) / static_cast<float>(system.divisions));
+    }
+
+    // Expand across the audible range, starting at the period just below it
+    table.size = 0;
+
+    float base = (std::isfinite(root_freq) && root_freq > 0.0f) ? root_freq : kMinTuningFrequency;
+    while (base > kMinTuningFrequency)
+        base /= period;
+
+    for (; base < kMaxTuningFrequency && table.size < kMaxTuningNotes; base *= period)
+    {
+        for (size_t k = 0; k < num_degrees && table.size < kMaxTuningNotes; k++)
+        {
+            float f = base * degrees[k];
+            if (f >= kMinTuningFrequency && f <= kMaxTuningFrequency)
+                table.freqs[table.size++] = f;
+        }
+    }
+    std::sort(table.freqs, table.freqs + table.size);
+}
+
+// Modulation Matrix
+// The active preset is expanded into a flat route list with the depth and
+// target spans already applied. The control task evaluates it once per tick:
+// the five sources are read, then each route is one multiply-add into its
+// target's offset, so the cost grows linearly with the routes and none of it
+// runs per sample. The LFOs advance by the time since the previous tick, so a
+// late tick doesn't slow them. Discrete targets round their offset, and only
+// a change in a rounded value republishes the tuning or the parameters; the
+// level, which moves continuously, goes to the engine as a single word.
+struct ModMatrix
+{
+    uint8_t num_routes = 0;
+    ModRoute routes[kMaxModRoutes];
+    float lfo_phase[2] = {0.0f, 0.0f};
+    uint32_t last_tick_us = 0;
+    float sources[kNumModSources] = {0.0f};
+    float offsets[kNumModTargets] = {0.0f};
+
+    // Expand a preset at depth (0..1)
+    void Load(size_t preset, float depth)
+    {
+        const ModPreset& mod = mod_presets[preset];
+        num_routes = mod.num_routes;
+        for (size_t r = 0; r < num_routes; r++)
+        {
+            routes[r] = mod.routes[r];
+            routes[r].amount *= depth * mod_target_spans[static_cast<size_t>(routes[r].target)];
+        }
+    }
+
+    // Advance both LFOs by dt seconds, the first at hz
+    void AdvanceLfos(float hz, float dt)
+    {
+        lfo_phase[0] = WrapCycle(lfo_phase[0] + hz * dt);
+        lfo_phase[1] = WrapCycle(lfo_phase[1] + hz * kLfo2Ratio * dt);
+        sources[static_cast<size_t>(ModSource::LFO1)] = SinCycle(lfo_phase[0]);
+        sources[static_cast<size_t>(ModSource::LFO2)] = SinCycle(lfo_phase[1]);
+    }
+
+    void Evaluate()
+    {
+        for (float& offset : offsets)
+            offset = 0.0f;
+        for (size_t r = 0; r < num_routes; r++)
+            offsets[static_cast<size_t>(routes[r].target)] += routes[r].amount
+                                                              * sources[static_cast<size_t>(routes[r].source)];
+    }
+};
+
+// Settings after modulation, as they reach the tuning table and the engine
+struct ModulatedSettings
+{
+    size_t scale;
+    int root_note_midi;
+    int fm_depth_percent;
+    int filter_cutoff_step;
+    int ratio_steps;   // Added to every divisor
+    float level;       // Output gain
+};
+
+ModMatrix mod_matrix;
+bool mod_routes_dirty = true;
+
+// Helper: LFO page value in Hz
+float LfoRateHz(int step)
+{
+    return kLfoMinHz * FastExp2(static_cast<float>(step) / 6.0f);
+}
+
+// Helper: A page value moved by its target's rounded offset, kept in range
+int Modulated(int value, ModTarget target, int lo, int hi)
+{
+    int offset = static_cast<int>(lroundf(mod_matrix.offsets[static_cast<size_t>(target)]));
+    return std::clamp(value + offset, lo, hi);
+}
+
+// Helper: Apply the current offsets to the page values. An open filter
+// stays bypassed rather than being swept in from the top.
+ModulatedSettings ApplyModulation()
+{
+    ModulatedSettings m;
+    m.scale = static_cast<size_t>(
+        Modulated(static_cast<int>(current_scale_idx), ModTarget::SCALE, 0, static_cast<int>(kNumScales) - 1));
+    m.root_note_midi = Modulated(root_note_midi, ModTarget::ROOT, 0, static_cast<int>(kNumNotes * kNumOctaves) - 1);
+    m.fm_depth_percent = Modulated(fm_depth_percent, ModTarget::FM_DEPTH, 0, kFmMaxDepth);
+    m.filter_cutoff_step = filter_cutoff_step >= kFilterCutoffSteps
+                               ? filter_cutoff_step
+                               : Modulated(filter_cutoff_step, ModTarget::CUTOFF, 0, kFilterCutoffSteps - 1);
+    m.ratio_steps = Modulated(0, ModTarget::RATIO, -static_cast<int>(kMaxRatio), static_cast<int>(kMaxRatio));
+    m.level = FastExp2(mod_matrix.offsets[static_cast<size_t>(ModTarget::LEVEL)]);
+    return m;
+}
+
+// Helper: Offset the divisors 2..5 by whole steps, keeping them in 1..kMaxRatio
+void BuildRatios(EngineParams& params, int steps)
+{
+    for (size_t j = 0; j < kNumSubharmonics; j++)
+        params.ratios[j] = std::clamp(static_cast<float>(static_cast<int>(j) + 2 + steps), 1.0f, kMaxRatio);
+}
+
+// Helper: Set the additive partial count with a 1/n undertone spectrum,
+// normalized over the active partials so each channel (even or odd partials)
+// peaks near unity whatever the count
+void BuildPartials(EngineParams& params, size_t count)
+{
+    count = std::max(kMinPartials, std::min(count, kMaxPartials));
+    float norm = 0.0f;
+    for (size_t n = 1; n <= count; n++)
+        norm += 1.0f / static_cast<float>(n);
+
+    params.num_partials = static_cast<uint8_t>(count);
+    for (size_t j = 0; j < kMaxPartials; j++)
+        params.partial_amps[j] = (j < count) ? 2.0f / (static_cast<float>(j + 1) * norm) : 0.0f;
+}
+
+// Helper: Compile the current tuning, scale and root into the idle table
+void RebuildTuningTable()
+{
+    ModulatedSettings m = ApplyModulation();
+    BuildTuningTable(ui_params.tuning, current_tuning_idx, m.scale, m.root_note_midi);
+    params_dirty = true;
+}
+
+// Helper: Scale an FM preset by depth (0..1) into a parameter block, listing
+// only the source rows that have a route
+void BuildFmMatrix(EngineParams& params, size_t preset, float depth)
+{
+    const FmPreset& fm = fm_presets[preset];
+    params.fm_mode = fm.mode;
+    params.fm_num_sources = 0;
+    for (size_t s = 0; s < kNumFmOperators; s++)
+    {
+        bool routed = false;
+        for (size_t t = 0; t < kNumFmOperators; t++)
+        {
+            params.fm_matrix[s][t] = fm.depth[s][t] * depth;
+            routed |= params.fm_matrix[s][t] != 0.0f;
+        }
+        if (routed && fm.mode != FmMode::OFF)
+            params.fm_sources[params.fm_num_sources++] = static_cast<uint8_t>(s);
+    }
+}
+
+// Helper: Apply a shaper preset and drive (0..1) to a parameter block
+void BuildShaper(EngineParams& params, size_t preset, float drive)
+{
+    const ShaperPreset& shaper = shaper_presets[preset];
+    params.shaper_mode = shaper.mode;
+    params.shaper_factor = shaper.factor;
+    params.shaper_gain = 2.0f * (1.0f + 7.0f * drive);
+}
+
+// Helper: Cutoff in Hz for a Cutoff page step
+float FilterCutoffHz(int step)
+{
+    return kFilterMinHz * FastExp2(static_cast<float>(step) / 12.0f);
+}
+
+// Helper: Apply a cutoff step and resonance (0..1) to a parameter block; the
+// top cutoff step bypasses the filter
+void BuildFilter(EngineParams& params, int cutoff_step, float resonance)
+{
+    params.filter_on = cutoff_step < kFilterCutoffSteps;
+    params.filter_cutoff = FilterCutoffHz(cutoff_step);
+    params.filter_feedback = kFilterMaxFeedback * resonance;
+}
+
+// Helper: Time page value in seconds
+float EnvelopeTime(int step)
+{
+    return kEnvMinTime * FastExp2(static_cast<float>(step) / 6.0f);
+}
+
+// Helper: Apply an envelope preset, its time (seconds), the filter envelope
+// depth (octaves) and the step clock tempo to a parameter block
+void BuildEnvelopes(EngineParams& params, size_t preset, float time, float cutoff_octaves, int bpm)
+{
+    const EnvelopePreset& env = envelope_presets[preset];
+    params.env_trigger = env.trigger;
+    params.env_amp = env.amp;
+    params.env_filter = env.filter;
+    for (EnvelopeShape* shape : {&params.env_amp, &params.env_filter})
+    {
+        shape->attack *= time;
+        shape->decay *= time;
+        shape->release *= time;
+    }
+    params.env_cutoff = cutoff_octaves;
+    params.seq_rate = static_cast<float>(bpm) / 60.0f;
+}
+
+// Helper: Quantize Frequency
+// Binary search of a tuning table. The nearer neighbour in pitch is the one
+// on the same side of their geometric mean, so no log is needed.
+ITCM_CODE float Quantize(const TuningTable& table, float freq)
+{
+    if (table.size == 0)
+        return freq;
+
+    const float* begin = table.freqs;
+    const float* end = table.freqs + table.size;
+    const float* upper = std::upper_bound(begin, end, freq);
+
+    if (upper == begin)
+        return *begin;
+    if (upper == end)
+        return *(end - 1);
+
+    float lo = *(upper - 1);
+    float hi = *upper;
+    return (freq * freq < lo * hi) ? lo : hi;
+}
+
+// Encoder Timer Interrupt: debounce and queue this tick's edges
+void EncoderTimerCallback(void*)
+{
+    patch.encoder.Debounce();
+
+    uint32_t now = System::GetUs();
+    int32_t increment = patch.encoder.Increment();
+    bool rising = patch.encoder.RisingEdge();
+    bool falling = patch.encoder.FallingEdge();
+    if (increment != 0)
+        encoder_events.Push({now, EncoderEventKind::TURN, static_cast<int8_t>(increment)});
+    if (rising)
+        encoder_events.Push({now, EncoderEventKind::PRESS, 0});
+    if (falling)
+        encoder_events.Push({now, EncoderEventKind::RELEASE, 0});
+
+    if (recorder.recording.load(std::memory_order_acquire) && (increment != 0 || rising || falling))
+    {
+        uint32_t sample = sample_clock.load(std::memory_order_relaxed);
+        if (increment != 0)
+            recorder.Record(sample, ControlKind::TURN, 0, static_cast<int8_t>(increment));
+        if (rising)
+            recorder.Record(sample, ControlKind::PRESS, 0, 0);
+        if (falling)
+            recorder.Record(sample, ControlKind::RELEASE, 0, 0);
+    }
+}
+
+// Helper: Start the encoder timer interrupt on TIM5 (TIM2 is the system clock)
+void StartEncoderTimer()
+{
+    TimerHandle::Config config;
+    config.periph = TimerHandle::Config::Peripheral::TIM_5;
+    config.dir = TimerHandle::Config::CounterDir::UP;
+    config.enable_irq = true;
+    encoder_timer.Init(config);
+    encoder_timer.SetPeriod(encoder_timer.GetFreq() / kEncoderTickHz - 1);
+    encoder_timer.SetCallback(EncoderTimerCallback);
+    encoder_timer.Start();
+}
+
+// Helper: Steps for one detent, from the time since the previous detent in
+// the same direction. Slow turns move one step; a fast flick moves up to
+// kAccelMaxStep per detent.
+int AcceleratedStep(const EncoderEvent& event)
+{
+    int dir = (event.delta > 0) ? 1 : -1;
+    uint32_t interval = event.time_us - last_turn_us;
+    bool same_dir = (dir == last_turn_dir);
+    last_turn_us = event.time_us;
+    last_turn_dir = dir;
+
+    if (!same_dir || interval >= kAccelSlowUs)
+        return 1;
+    if (interval <= kAccelFastUs)
+        return kAccelMaxStep;
+    return 1 + static_cast<int>((kAccelMaxStep - 1) * (kAccelSlowUs - interval) / (kAccelSlowUs - kAccelFastUs));
+}
+
+// Helper: Step an index by a signed amount. Single steps wrap around;
+// accelerated steps stop at the ends so a flick can't overshoot past them.
+size_t StepIndex(size_t value, int step, size_t size)
+{
+    int next = static_cast<int>(value) + step;
+    int last = static_cast<int>(size) - 1;
+    if (step > 1 || step < -1)
+        return static_cast<size_t>(std::clamp(next, 0, last));
+
+    int wrapped = next % static_cast<int>(size);
+    return static_cast<size_t>(wrapped < 0 ? wrapped + static_cast<int>(size) : wrapped);
+}
+
+// Helper: Copy the UI state into a session header; replay also uses it for
+// the defaults of fields an older session version lacks
+void SnapshotUiState(SessionHeader& h)
+{
+    h.root_note_midi = root_note_midi;
+    h.scale = static_cast<uint8_t>(current_scale_idx);
+    h.tuning = static_cast<uint8_t>(current_tuning_idx);
+    h.voice_mode = static_cast<uint8_t>(voice_mode);
+    h.menu_state = static_cast<uint8_t>(menu_state);
+    h.menu_active = menu_active ? 1 : 0;
+    h.display_mode = static_cast<uint8_t>(display_mode);
+    h.fm_preset = static_cast<uint8_t>(current_fm_preset);
+    h.fm_depth = static_cast<uint8_t>(fm_depth_percent);
+    h.shaper_preset = static_cast<uint8_t>(current_shaper_preset);
+    h.shaper_drive = static_cast<uint8_t>(shaper_drive_percent);
+    h.filter_cutoff = static_cast<uint8_t>(filter_cutoff_step);
+    h.filter_resonance = static_cast<uint8_t>(filter_resonance_percent);
+    h.env_preset = static_cast<uint8_t>(current_env_preset);
+    h.env_time = static_cast<uint8_t>(env_time_step);
+    h.env_cutoff = static_cast<uint8_t>(env_cutoff_tenths);
+    h.mod_preset = static_cast<uint8_t>(current_mod_preset);
+    h.mod_depth = static_cast<uint8_t>(mod_depth_percent);
+    h.lfo_rate = static_cast<uint8_t>(lfo_rate_step);
+    h.seq_bpm = static_cast<uint16_t>(seq_bpm);
+    h.partials = static_cast<uint8_t>(num_partials);
+}
+
+// Helper: Snapshot the UI state into the session header and start logging
+void StartRecording()
+{
+    SessionHeader& h = recorder.header;
+    std::memcpy(h.magic, "SHRC", sizeof(h.magic));
+    h.version = kSessionVersion;
+    h.record_size = sizeof(ControlRecord);
+    h.sample_rate = static_cast<uint32_t>(patch.AudioSampleRate());
+    h.block_size = static_cast<uint32_t>(patch.AudioBlockSize());
+    h.first_sample = sample_clock.load(std::memory_order_relaxed);
+    h.num_records = 0;
+    SnapshotUiState(h);
+
+    recorder.count.store(0, std::memory_order_relaxed);
+    recorder.last_pitch = kRecorderNoPitch;
+    recorder.last_gate = 2;
+    for (uint32_t& cv : recorder.last_cv)
+        cv = kRecorderNoPitch;
+    recorder.state = RecorderState::RECORDING;
+    recorder.recording.store(true, std::memory_order_release);
+}
+
+// Helper: Apply one detent (delta is +1 or -1) to the current menu page or view
+void HandleTurn(const EncoderEvent& event)
+{
+    int delta = (event.delta > 0) ? 1 : -1;
+    int step = delta * AcceleratedStep(event);
+
+    if (!menu_active)
+    {
+        // Cycle through the display views
+        display_mode = static_cast<DisplayMode>(StepIndex(static_cast<size_t>(display_mode), delta, kNumDisplayModes));
+        return;
+    }
+
+    // Long lists (scales, root note, depths, cutoff, times, rates, partials) accelerate; short ones step by one
+    if (menu_state == MenuState::SCALE_SELECTION)
+    {
+        current_scale_idx = StepIndex(current_scale_idx, step, kNumScales);
+        tuning_dirty = true;
+        TracePoint(TraceType::SCALE, static_cast<uint8_t>(current_scale_idx));
+    }
+    else if (menu_state == MenuState::ROOT_NOTE_SELECTION)
+    {
+        root_note_midi = static_cast<int>(StepIndex(static_cast<size_t>(root_note_midi), step, kNumNotes * kNumOctaves));
+        tuning_dirty = true;
+        TracePoint(TraceType::ROOT, 0, static_cast<uint16_t>(root_note_midi));
+    }
+    else if (menu_state == MenuState::TUNING_SELECTION)
+    {
+        current_tuning_idx = StepIndex(current_tuning_idx, delta, kNumTunings);
+        tuning_dirty = true;
+        TracePoint(TraceType::TUNING, static_cast<uint8_t>(current_tuning_idx));
+    }
+    else if (menu_state == MenuState::MODE_SELECTION)
+    {
+        voice_mode = static_cast<VoiceMode>(StepIndex(static_cast<size_t>(voice_mode), delta, kNumVoiceModes));
+        params_dirty = true;
+        TracePoint(TraceType::VOICE_MODE, static_cast<uint8_t>(voice_mode));
+    }
+    else if (menu_state == MenuState::CALIBRATION)
+    {
+        if (delta < 0)
+        {
+            calibration_step = 0; // Restart the capture sequence
+        }
+        else if (calibration_step < kNumCalibrationPoints)
+        {
+            // Capture the reading for the requested voltage and advance
+            calibration_capture.readings[calibration_step++] = patch.controls[CTRL_PITCH].Value();
+            if (calibration_step == kNumCalibrationPoints)
+                calibration_save_pending = true;
+        }
+    }
+    else if (menu_state == MenuState::RECORDER)
+    {
+        if (recorder.state == RecorderState::RECORDING)
+        {
+            // Right stops and saves, left discards
+            recorder.recording.store(false, std::memory_order_release);
+            recorder.state = (delta > 0) ? RecorderState::SAVING : RecorderState::IDLE;
+            recorder.saved = 0;
+        }
+        else if (delta > 0 && recorder.state != RecorderState::SAVING)
+        {
+            StartRecording();
+        }
+    }
+    else if (menu_state == MenuState::TRACE)
+    {
+        if (delta > 0 && trace_dump.state != TraceDumpState::WRITING)
+            trace_dump.requested = true;
+    }
+    else if (menu_state == MenuState::FM_ROUTING)
+    {
+        current_fm_preset = StepIndex(current_fm_preset, delta, kNumFmPresets);
+        params_dirty = true;
+        TracePoint(TraceType::FM, static_cast<uint8_t>(current_fm_preset), static_cast<uint16_t>(fm_depth_percent));
+    }
+    else if (menu_state == MenuState::FM_DEPTH)
+    {
+        fm_depth_percent = std::max(0, std::min(kFmMaxDepth, fm_depth_percent + step));
+        params_dirty = true;
+        TracePoint(TraceType::FM, static_cast<uint8_t>(current_fm_preset), static_cast<uint16_t>(fm_depth_percent));
+    }
+    else if (menu_state == MenuState::SHAPER)
+    {
+        current_shaper_preset = StepIndex(current_shaper_preset, delta, kNumShaperPresets);
+        params_dirty = true;
+        TracePoint(TraceType::SHAPER, static_cast<uint8_t>(current_shaper_preset),
+                   static_cast<uint16_t>(shaper_drive_percent));
+    }
+    else if (menu_state == MenuState::SHAPER_DRIVE)
+    {
+        shaper_drive_percent = std::max(0, std::min(kShaperMaxDrive, shaper_drive_percent + step));
+        params_dirty = true;
+        TracePoint(TraceType::SHAPER, static_cast<uint8_t>(current_shaper_preset),
+                   static_cast<uint16_t>(shaper_drive_percent));
+    }
+    else if (menu_state == MenuState::FILTER_CUTOFF)
+    {
+        filter_cutoff_step = std::max(0, std::min(kFilterCutoffSteps, filter_cutoff_step + step));
+        params_dirty = true;
+        TracePoint(TraceType::FILTER, static_cast<uint8_t>(filter_cutoff_step),
+                   static_cast<uint16_t>(filter_resonance_percent));
+    }
+    else if (menu_state == MenuState::FILTER_RESONANCE)
+    {
+        filter_resonance_percent = std::max(0, std::min(kFilterMaxResonance, filter_resonance_percent + step));
+        params_dirty = true;
+        TracePoint(TraceType::FILTER, static_cast<uint8_t>(filter_cutoff_step),
+                   static_cast<uint16_t>(filter_resonance_percent));
+    }
+    else if (menu_state == MenuState::ENVELOPE || menu_state == MenuState::ENV_TIME
+             || menu_state == MenuState::ENV_CUTOFF)
+    {
+        if (menu_state == MenuState::ENVELOPE)
+            current_env_preset = StepIndex(current_env_preset, delta, kNumEnvelopePresets);
+        else if (menu_state == MenuState::ENV_TIME)
+            env_time_step = std::max(0, std::min(kEnvTimeSteps, env_time_step + step));
+        else
+            env_cutoff_tenths = std::max(0, std::min(kEnvMaxCutoff, env_cutoff_tenths + step));
+        params_dirty = true;
+        TracePoint(TraceType::ENVELOPE, static_cast<uint8_t>(current_env_preset),
+                   static_cast<uint16_t>(env_time_step | env_cutoff_tenths << 8));
+    }
+    else if (menu_state == MenuState::SEQ_RATE)
+    {
+        seq_bpm = std::max(kSeqMinBpm, std::min(kSeqMaxBpm, seq_bpm + step));
+        params_dirty = true;
+        TracePoint(TraceType::SEQ_RATE, 0, static_cast<uint16_t>(seq_bpm));
+    }
+    else if (menu_state == MenuState::MOD_ROUTING || menu_state == MenuState::MOD_DEPTH
+             || menu_state == MenuState::LFO_RATE)
+    {
+        if (menu_state == MenuState::MOD_ROUTING)
+            current_mod_preset = StepIndex(current_mod_preset, delta, kNumModPresets);
+        else if (menu_state == MenuState::MOD_DEPTH)
+            mod_depth_percent = std::max(0, std::min(kModMaxDepth, mod_depth_percent + step));
+        else
+            lfo_rate_step = std::max(0, std::min(kLfoRateSteps, lfo_rate_step + step));
+        mod_routes_dirty = true;
+        TracePoint(TraceType::MOD, static_cast<uint8_t>(current_mod_preset),
+                   static_cast<uint16_t>(mod_depth_percent | lfo_rate_step << 8));
+    }
+    else if (menu_state == MenuState::PARTIALS)
+    {
+        num_partials = std::max(static_cast<int>(kMinPartials), std::min(static_cast<int>(kMaxPartials), num_partials + step));
+        params_dirty = true;
+        TracePoint(TraceType::PARTIALS, static_cast<uint8_t>(num_partials));
+    }
+}
+
+// Helper: A press toggles the menu; opening it moves to the next page
+void HandlePress()
+{
+    menu_active = !menu_active;
+    if (!menu_active)
+    {
+        display_mode = DisplayMode::WAVEFORM; // Exit to waveform view
+        return;
+    }
+
+    menu_state = static_cast<MenuState>((static_cast<size_t>(menu_state) + 1) % kNumMenuStates);
+    if (menu_state == MenuState::CALIBRATION)
+        calibration_step = 0;
+}
+
+// Update Encoder and Menu Navigation: drain the event queue
+void UpdateEncoder()
+{
+    EncoderEvent event;
+    while (encoder_events.Pop(event))
+    {
+        // Note the first unrendered input for the latency metric
+        if (!input_pending)
+        {
+            input_pending = true;
+            input_pending_us = event.time_us;
+        }
+
+        if (event.kind == EncoderEventKind::TURN)
+        {
+            for (int i = 0; i < std::abs(event.delta); i++)
+                HandleTurn(event);
+        }
+        else if (event.kind == EncoderEventKind::PRESS)
+        {
+            HandlePress();
+        }
+    }
+}
+
+// Helper: Map a sample to a clamped scope row
+inline int ScopeY(float v)
+{
+    return std::max(0, std::min(63, static_cast<int>((v * 20.0f) + 32.0f)));
+}
+
+// Spectrum Analyzer
+// The engine decimates the mono mix by kSpectrumDecimation through three 2:1
+// half-band stages into a Q15 snapshot. The first two stages only have to
+// keep their aliases out of the final band, so they use the short 4x filter;
+// the last uses the 2x filter, which keeps 0..2.5 kHz flat and rejects 3.5 kHz
+// and up by 100 dB. The filters pause with the capture, and the first
+// kSpectrumSettle outputs after a restart are dropped while their history
+// clears. The main loop then runs a fixed-point radix-4 FFT on it one
+// step per call (window, four butterfly stages, digit reversal, real split,
+// column mapping), so no single main-loop pass does more than a stage of work.
+struct SpectrumAnalyzer
+{
+    enum class Step : uint8_t
+    {
+        WINDOW,
+        STAGE,
+        REORDER,
+        MAGNITUDE,
+        COLUMNS
+    };
+
+    // Audio side: decimated snapshot, owned by audio until snapshot_ready
+    std::atomic<bool> snapshot_ready{false};
+    int16_t snapshot[kFftSize];
+    size_t snapshot_pos = 0;
+    size_t settle = kSpectrumSettle;
+    bool capturing = false;
+    HalfBand<kHalfBandCoefs4x> decimate_48k, decimate_24k;
+    HalfBand<kHalfBandCoefs2x> decimate_12k;
+    float held[3][2];          // First sample of each stage's pair
+    uint8_t held_mask = 0;     // Bit per stage: a sample is held
+
+    // Main loop side
+    Step step = Step::WINDOW;
+    size_t stage = 0;
+    int32_t re[kFftComplexSize];
+    int32_t im[kFftComplexSize];
+    int16_t window[kFftSize];
+    int16_t twiddle_cos[kFftSize]; // cos(2*pi*k/kFftSize), Q15
+    int16_t twiddle_sin[kFftSize];
+    float power_db[kFftComplexSize];
+    uint16_t column_bin_lo[kDisplayWidth];
+    uint16_t column_bin_hi[kDisplayWidth];
+    uint8_t columns[kDisplayWidth] = {0};
+
+    void Init(float sample_rate)
+    {
+        decimate_48k.Init();
+        decimate_24k.Init();
+        decimate_12k.Init();
+
+        for (size_t k = 0; k < kFftSize; k++)
+        {
+            float phase = TWOPI_F * static_cast<float>(k) / static_cast<float>(kFftSize);
+            window[k] = static_cast<int16_t>(32767.0f * (0.5f - 0.5f * cosf(phase)));
+            twiddle_cos[k] = static_cast<int16_t>(32767.0f * cosf(phase));
+            twiddle_sin[k] = static_cast<int16_t>(32767.0f * sinf(phase));
+        }
+
+        // Log-spaced columns from kSpectrumMinHz up to the analysis Nyquist
+        float bin_hz = sample_rate / kSpectrumDecimation / kFftSize;
+        float max_hz = bin_hz * (kFftComplexSize - 1);
+        float octaves = log2f(max_hz / kSpectrumMinHz);
+        for (size_t c = 0; c < kDisplayWidth; c++)
+        {
+            float f_lo = kSpectrumMinHz * exp2f(octaves * c / kDisplayWidth);
+            float f_hi = kSpectrumMinHz * exp2f(octaves * (c + 1) / kDisplayWidth);
+            column_bin_lo[c] = static_cast<uint16_t>(std::min(f_lo / bin_hz + 0.5f, max_hz / bin_hz));
+            column_bin_hi[c] = std::max(column_bin_lo[c], static_cast<uint16_t>(std::min(f_hi / bin_hz + 0.5f, max_hz / bin_hz)));
+        }
+    }
+
+    // Helper: Hold the first sample of a pair, or decimate the pair into x
+    template <size_t N>
+    inline bool Decimate(HalfBand<N>& filter, const float* coefs, size_t stage, float* x)
+    {
+        uint8_t bit = static_cast<uint8_t>(1u << stage);
+        if (!(held_mask & bit))
+        {
+            held[stage][0] = x[0];
+            held[stage][1] = x[1];
+            held_mask |= bit;
+            return false;
+        }
+        held_mask &= static_cast<uint8_t>(~bit);
+        float y[2];
+        filter.Downsample(coefs, held[stage], x, y);
+        x[0] = y[0];
+        x[1] = y[1];
+        return true;
+    }
+
+    // Audio side: a half-band stage every second sample, halving at each
+    // stage, and one store per kSpectrumDecimation
+    ITCM_CODE inline void Capture(float in)
+    {
+        if (snapshot_ready.load(std::memory_order_relaxed))
+        {
+            capturing = false;
+            return;
+        }
+        if (!capturing)
+        {
+            capturing = true;
+            settle = kSpectrumSettle;
+        }
+
+        // The filters run two lanes; the mono mix only needs one
+        float x[2] = {in, 0.0f};
+        if (!Decimate(decimate_48k, halfband_4x, 0, x) || !Decimate(decimate_24k, halfband_4x, 1, x)
+            || !Decimate(decimate_12k, halfband_2x, 2, x))
+            return;
+        if (settle > 0)
+        {
+            settle--;
+            return;
+        }
+
+        snapshot[snapshot_pos] = static_cast<int16_t>(std::fmax(-1.0f, std::fmin(1.0f, x[0])) * 32767.0f);
+        if (++snapshot_pos == kFftSize)
+        {
+            snapshot_pos = 0;
+            snapshot_ready.store(true, std::memory_order_release);
+        }
+    }
+
+    // Main loop side: advance one step; returns true when columns are updated
+    bool Process()
+    {
+        switch (step)
+        {
+            case Step::WINDOW:
+                if (!snapshot_ready.load(std::memory_order_acquire))
+                    return false;
+                // Pack even/odd real samples into one half-length complex FFT
+                for (size_t n = 0; n < kFftComplexSize; n++)
+                {
+                    re[n] = (snapshot[2 * n] * window[2 * n]) >> 15;
+                    im[n] = (snapshot[2 * n + 1] * window[2 * n + 1]) >> 15;
+                }
+                snapshot_ready.store(false, std::memory_order_release);
+                stage = 0;
+                step = Step::STAGE;
+                return false;
+
+            case Step::STAGE:
+                RunStage(stage);
+                if (++stage == kFftStages)
+                    step = Step::REORDER;
+                return false;
+
+            case Step::REORDER:
+                DigitReverse();
+                step = Step::MAGNITUDE;
+                return false;
+
+            case Step::MAGNITUDE:
+                SplitReal();
+                step = Step::COLUMNS;
+                return false;
+
+            case Step::COLUMNS:
+            default:
+                MapColumns();
+                step = Step::WINDOW;
+                return true;
+        }
+    }
+
+    // One decimation-in-frequency radix-4 pass, scaled by 1/4 to stay in range
+    void RunStage(size_t s)
+    {
+        size_t span = kFftComplexSize >> (2 * s);      // Butterfly group size
+        size_t quarter = span / 4;
+        size_t tw_stride = 2 * (kFftComplexSize / span); // Twiddle table is kFftSize long
+
+        for (size_t j = 0; j < quarter; j++)
+        {
+            int32_t c1 = twiddle_cos[j * tw_stride], s1 = twiddle_sin[j * tw_stride];
+            int32_t c2 = twiddle_cos[2 * j * tw_stride], s2 = twiddle_sin[2 * j * tw_stride];
+            int32_t c3 = twiddle_cos[3 * j * tw_stride], s3 = twiddle_sin[3 * j * tw_stride];
+
+            for (size_t i0 = j; i0 < kFftComplexSize; i0 += span)
+            {
+                size_t i1 = i0 + quarter, i2 = i1 + quarter, i3 = i2 + quarter;
+
+                int32_t a0r = re[i0] + re[i2], a0i = im[i0] + im[i2];
+                int32_t a1r = re[i0] - re[i2], a1i = im[i0] - im[i2];
+                int32_t b0r = re[i1] + re[i3], b0i = im[i1] + im[i3];
+                int32_t b1r = re[i1] - re[i3], b1i = im[i1] - im[i3];
+
+                re[i0] = (a0r + b0r) >> 2;
+                im[i0] = (a0i + b0i) >> 2;
+
+                // Outputs 1..3 rotated by W^j, W^2j, W^3j where W = exp(-i*2*pi/N)
+                ComplexTwiddle((a1r + b1i) >> 2, (a1i - b1r) >> 2, c1, s1, re[i1], im[i1]);
+                ComplexTwiddle((a0r - b0r) >> 2, (a0i - b0i) >> 2, c2, s2, re[i2], im[i2]);
+                ComplexTwiddle((a1r - b1i) >> 2, (a1i + b1r) >> 2, c3, s3, re[i3], im[i3]);
+            }
+        }
+    }
+
+    static inline void ComplexTwiddle(int32_t xr, int32_t xi, int32_t c, int32_t s, int32_t& out_r, int32_t& out_i)
+    {
+        out_r = static_cast<int32_t>((static_cast<int64_t>(xr) * c + static_cast<int64_t>(xi) * s) >> 15);
+        out_i = static_cast<int32_t>((static_cast<int64_t>(xi) * c - static_cast<int64_t>(xr) * s) >> 15);
+    }
+
+    // Undo the base-4 digit reversal left by the DIF passes
+    void DigitReverse()
+    {
+        for (size_t i = 0; i < kFftComplexSize; i++)
+        {
+            size_t r = 0;
+            for (size_t d = 0, v = i; d < kFftStages; d++, v >>= 2)
+                r = (r << 2) | (v & 3);
+            if (r > i)
+            {
+                std::swap(re[i], re[r]);
+                std::swap(im[i], im[r]);
+            }
+        }
+    }
+
+    // Separate the packed even/odd spectra into real-input bins, then to dB
+    void SplitReal()
+    {
+        for (size_t k = 0; k < kFftComplexSize; k++)
+        {
+            size_t m = (kFftComplexSize - k) & (kFftComplexSize - 1);
+            int32_t er = (re[k] + re[m]) >> 1, ei = (im[k] - im[m]) >> 1;
+            int32_t orr = (im[k] + im[m]) >> 1, oi = (re[m] - re[k]) >> 1;
+
+            int32_t wr, wi;
+            ComplexTwiddle(orr, oi, twiddle_cos[k], twiddle_sin[k], wr, wi);
+            float xr = static_cast<float>(er + wr);
+            float xi = static_cast<float>(ei + wi);
+            power_db[k] = 3.0103f * FastLog2(xr * xr + xi * xi + 1.0f);
+        }
+    }
+
+    // Peak of each column's bins, with a gentle fall so partials don't flicker
+    void MapColumns()
+    {
+        // A full-scale sine peaks near 84 dB after the fixed-point scaling
+        const float top_db = 84.0f;
+        for (size_t c = 0; c < kDisplayWidth; c++)
+        {
+            float peak = 0.0f;
+            for (size_t b = column_bin_lo[c]; b <= column_bin_hi[c]; b++)
+                peak = std::fmax(peak, power_db[b]);
+
+            float height = (peak - (top_db - kSpectrumRangeDb)) * (kDisplayHeight / kSpectrumRangeDb);
+            uint8_t h = static_cast<uint8_t>(std::fmax(0.0f, std::fmin(static_cast<float>(kDisplayHeight), height)));
+            columns[c] = std::max<uint8_t>(h, columns[c] > 2 ? columns[c] - 2 : 0);
+        }
+    }
+};
+
+// Ladder Filter
+// Four-pole lowpass in zero-delay-feedback form: four one-pole TPT stages
+// with the global feedback loop solved in closed form each sample, so the
+// resonance tracks the cutoff without the unit delay of a naive ladder. The
+// feedback input is soft-clipped, which bounds self-oscillation. L and R are
+// two lanes sharing one set of coefficients. Cutoff and resonance glide
+// towards the parameter block once per audio block (the control rate): the
+// cutoff in octaves, with one tanf per block, and the per-sample coefficients
+// ramp linearly across the block so a cutoff sweep does not step. The filter
+// envelope is added after the glide, so it stays as sharp as it was set.
+struct LadderFilter
+{
+    float sample_rate = 48000.0f;
+    float glide = 0.0f;        // Glide time in samples
+    bool active = false;       // False while bypassed
+    float octave = 0.0f;       // Smoothed cutoff, log2 Hz
+    float g = 0.0f;            // Stage gain G = g / (1 + g), g = tan(pi fc / fs)
+    float g_end = 0.0f;
+    float g_step = 0.0f;
+    float k = 0.0f;            // Feedback
+    float k_end = 0.0f;
+    float k_step = 0.0f;
+    float s[4][2] = {{0.0f}};  // Per stage and lane
+
+    void Init(float sr)
+    {
+        sample_rate = sr;
+        glide = kFilterGlide * sr;
+        active = false;
+    }
+
+    // Helper: Stage gain for a cutoff in log2 Hz
+    ITCM_CODE float StageGain(float log2_hz) const
+    {
+        float fc = std::fmin(FastExp2(log2_hz), sample_rate * 0.45f);
+        float t = tanf(PI_F * fc / sample_rate);
+        return t / (1.0f + t);
+    }
+
+    void Bypass()
+    {
+        active = false;
+    }
+
+    // Call once at the start of each filtered audio block; offset moves the
+    // cutoff at the end of the block, in octaves
+    ITCM_CODE void BeginBlock(const EngineParams& p, float offset, size_t size)
+    {
+        const float target = FastLog2(p.filter_cutoff);
+        if (!active)
+        {
+            // Coming out of bypass: start clean at the target
+            for (size_t j = 0; j < 4; j++)
+                s[j][0] = s[j][1] = 0.0f;
+            octave = target;
+            g_end = StageGain(octave + offset);
+            k_end = p.filter_feedback;
+            active = true;
+        }
+
+        float n = static_cast<float>(size);
+        float alpha = n / (n + glide);
+        octave += alpha * (target - octave);
+
+        g = g_end;
+        k = k_end;
+        g_end = StageGain(octave + offset);
+        k_end = k + alpha * (p.filter_feedback - k);
+        g_step = (g_end - g) / n;
+        k_step = (k_end - k) / n;
+    }
+
+    ITCM_CODE void Process(float& out_l, float& out_r)
+    {
+        g += g_step;
+        k += k_step;
+        const float g2 = g * g;
+        const float inv = 1.0f / (1.0f + k * g2 * g2);
+
+        float x[2] = {out_l, out_r};
+        for (size_t c = 0; c < 2; c++)
+        {
+            // Stage output is G x + (1 - G) s, so the loop output is
+            // G^4 u + S with S from the states alone
+            float sum = (1.0f - g) * (((g * s[0][c] + s[1][c]) * g + s[2][c]) * g + s[3][c]);
+            float u = SoftClip((x[c] - k * sum) * inv);
+            for (size_t j = 0; j < 4; j++)
+            {
+                float v = (u - s[j][c]) * g;
+                float y = v + s[j][c];
+                s[j][c] = y + v;
+                u = y;
+            }
+            x[c] = u;
+        }
+
+        out_l = x[0];
+        out_r = x[1];
+    }
+};
+
+// Envelope
+// Attack-decay or ADSR generator evaluated once per audio block. At the top
+// of a block it works out the level the block should end on, with the
+// decays' exponential taken once per block in FastExp2, and the gain then
+// moves there in equal per-sample steps. The audio loop pays one add per
+// sample and a segment can only change at a block boundary (1 ms at 48
+// samples), far finer than any audible articulation.
+struct Envelope
+{
+    enum class Stage : uint8_t
+    {
+        IDLE,
+        ATTACK,
+        DECAY,
+        SUSTAIN,
+        RELEASE
+    };
+
+    Stage stage = Stage::IDLE;
+    float level = 0.0f;   // At the end of the current block
+    float gain = 0.0f;    // Per-sample ramp towards level
+    float step = 0.0f;
+
+    void Init()
+    {
+        stage = Stage::IDLE;
+        level = 0.0f;
+        gain = 0.0f;
+        step = 0.0f;
+    }
+
+    // Helper: Factor a decay of time t (to -60 dB) applies over dt seconds
+    ITCM_CODE static float Fall(float dt, float t)
+    {
+        return FastExp2(-9.9657843f * dt / std::fmax(t, kEnvMinTime * 0.1f));
+    }
+
+    // Call once at the start of each block of n samples lasting dt seconds.
+    // trigger restarts the attack from the current level; gate is the held
+    // state an ADSR shape sustains on.
+    ITCM_CODE void BeginBlock(const EnvelopeShape& shape, bool trigger, bool gate, float dt, size_t n)
+    {
+        const float start = level;
+        if (trigger)
+            stage = Stage::ATTACK;
+        else if (shape.hold && !gate && stage != Stage::IDLE)
+            stage = Stage::RELEASE;
+
+        switch (stage)
+        {
+            case Stage::ATTACK:
+                level += dt / std::fmax(shape.attack, kEnvMinTime * 0.1f);
+                if (level >= 1.0f)
+                {
+                    level = 1.0f;
+                    stage = Stage::DECAY;
+                }
+                break;
+            case Stage::DECAY:
+            {
+                float target = shape.hold ? shape.sustain : 0.0f;
+                level = target + (level - target) * Fall(dt, shape.decay);
+                if (level - target < kEnvFloor)
+                {
+                    level = target;
+                    stage = shape.hold ? Stage::SUSTAIN : Stage::IDLE;
+                }
+                break;
+            }
+            case Stage::SUSTAIN: level = shape.sustain; break;
+            case Stage::RELEASE:
+                level *= Fall(dt, shape.release);
+                if (level < kEnvFloor)
+                {
+                    level = 0.0f;
+                    stage = Stage::IDLE;
+                }
+                break;
+            case Stage::IDLE: level = 0.0f; break;
+        }
+
+        gain = start;
+        step = (level - start) / static_cast<float>(n);
+    }
+
+    ITCM_CODE float Next()
+    {
+        gain += step;
+        return gain;
+    }
+};
+
+// Subharmonic Engine
+// One complete instance of the module's DSP: the parameter handoff, the
+// sine, resonator and additive banks, the shaper, ladder filter and
+// envelopes on the mix, and the taps the display reads
+// (waveform history, scope, spectrum snapshot, tuner readout). The UI side
+// calls SetParams(); the audio side calls ProcessBlock() with a block of
+// audio input and pitch CV readings. Nothing outside the instance is
+// touched, so any number can run side by side. AudioCallback drives the one
+// the module uses, and host/batch_render.cpp renders one per job on worker
+// threads.
+struct SubharmonicEngine
+{
+    // Parameter blocks from the UI
+    TripleBuffer<EngineParams> params;
+
+    // Voice
+    SineBank sines;
+    ResonatorBank resonators;
+    AdditiveBank additive;
+    float input_freq;   // Last CV frequency, before quantizing
+    float freq;         // Last quantized frequency
+    float ratios[kNumSubharmonics];   // Divisors the banks are tuned to
+    float max_ratio;
+    float level;        // Output gain at the end of the last block
+    std::atomic<float> target_level{1.0f};   // Output gain from the UI, ramped to over each block
+    Waveshaper shaper;
+    LadderFilter ladder;
+
+    // Articulation. The envelopes fire on a rising gate, from gate input 1
+    // (SetGate) or the step clock, which is high for the first half of each
+    // step.
+    float sample_rate;
+    Envelope amp_env;
+    Envelope filter_env;
+    float step_phase;    // Step clock, cycles
+    bool gate_in;
+    bool gate;           // Last block's trigger gate
+
+    // Display taps
+    std::array<float, kWaveformBufferSize> osc_buffer_l;
+    std::array<float, kWaveformBufferSize> osc_buffer_r;
+    size_t buffer_index;
+    ScopeCapture scope;
+    SpectrumAnalyzer spectrum;
+    Seqlock<TunerSnapshot> tuner_snapshot;   // Published once per block
+
+    // Sets up every member, so an engine may start out zeroed
+    void Init(float sample_rate)
+    {
+        params.Init();
+        sines.Init(sample_rate);
+        resonators.Init(sample_rate);
+        additive.Init(sample_rate);
+        input_freq = 0.0f;
+        freq = 0.0f;
+        for (size_t j = 0; j < kNumSubharmonics; j++)
+            ratios[j] = 0.0f;   // Taken from the first parameter block
+        max_ratio = 1.0f;
+        level = 1.0f;
+        shaper.Init();
+        ladder.Init(sample_rate);
+        this->sample_rate = sample_rate;
+        amp_env.Init();
+        filter_env.Init();
+        step_phase = 0.0f;
+        gate_in = false;
+        gate = false;
+
+        osc_buffer_l.fill(0.0f);
+        osc_buffer_r.fill(0.0f);
+        buffer_index = 0;
+        scope.Init(sample_rate);
+        spectrum.Init(sample_rate);
+    }
+
+    // UI side: hand over a full parameter block for the next audio block
+    void SetParams(const EngineParams& p)
+    {
+        params.Publish(p);
+    }
+
+    // UI side: output gain for the next audio block; one store, so the
+    // modulation matrix can move it every tick without a parameter block
+    void SetLevel(float gain)
+    {
+        target_level.store(gain, std::memory_order_relaxed);
+    }
+
+    // Audio side: gate input state for the next block
+    void SetGate(bool high)
+    {
+        gate_in = high;
+    }
+
+    // Audio side: render size samples; in excites the resonators
+    ITCM_CODE void ProcessBlock(const float* in, const float* pitch_cv, float* out_l, float* out_r, size_t size)
+    {
+        // Pick up the newest parameter block; it holds for the whole block
+        const EngineParams& p = params.Acquire();
+        const VoiceMode mode = p.voice_mode;
+        if (mode == VoiceMode::ADDITIVE)
+            additive.BeginBlock(p, size);
+
+        // New divisors retune the banks on the next sample
+        if (std::memcmp(ratios, p.ratios, sizeof(ratios)) != 0)
+        {
+            std::memcpy(ratios, p.ratios, sizeof(ratios));
+            max_ratio = 1.0f;
+            for (size_t j = 0; j < kNumSubharmonics; j++)
+                max_ratio = std::fmax(max_ratio, ratios[j]);
+            sines.tuned_freq = -1.0f;
+            resonators.tuned_freq = -1.0f;
+        }
+
+        // The output level ramps across the block; at unity it costs nothing
+        const float block_level = target_level.load(std::memory_order_relaxed);
+        const bool leveled = block_level != 1.0f || level != 1.0f;
+        const float level_step = (block_level - level) / static_cast<float>(size);
+
+        const bool articulated = p.env_trigger != EnvTrigger::OFF;
+        if (articulated)
+        {
+            const float dt = static_cast<float>(size) / sample_rate;
+            bool next = gate_in;
+            if (p.env_trigger == EnvTrigger::SEQUENCER)
+            {
+                step_phase = WrapCycle(step_phase + p.seq_rate * dt);
+                next = step_phase < 0.5f;
+            }
+            const bool trigger = next && !gate;
+            gate = next;
+            amp_env.BeginBlock(p.env_amp, trigger, gate, dt, size);
+            filter_env.BeginBlock(p.env_filter, trigger, gate, dt, size);
+        }
+
+        if (p.filter_on)
+            ladder.BeginBlock(p, articulated ? filter_env.level * p.env_cutoff : 0.0f, size);
+        else
+            ladder.Bypass();
+        if (p.shaper_mode == ShaperMode::OFF)
+            shaper.Bypass();
+
+        for (size_t i = 0; i < size; i++)
+        {
+            input_freq = CvToFrequency(p.cv_table, pitch_cv[i]);
+            freq = Quantize(p.tuning, input_freq);
+
+            float mix_l = 0.0f, mix_r = 0.0f;
+
+            if (mode == VoiceMode::RESONATOR)
+            {
+                resonators.SetFreq(freq, ratios);
+                resonators.Process(in[i], mix_l, mix_r);
+            }
+            else if (mode == VoiceMode::ADDITIVE)
+            {
+                additive.SetFreq(freq);
+                additive.Process(mix_l, mix_r);
+            }
+            else
+            {
+                sines.SetFreq(freq, ratios);
+                sines.Process(p, mix_l, mix_r);
+            }
+
+            mix_l *= 0.5f;
+            mix_r *= 0.5f;
+            if (p.shaper_mode != ShaperMode::OFF)
+                shaper.Process(p, mix_l, mix_r);
+            if (p.filter_on)
+                ladder.Process(mix_l, mix_r);
+            if (articulated)
+            {
+                float a = amp_env.Next();
+                mix_l *= a;
+                mix_r *= a;
+            }
+            if (leveled)
+            {
+                level += level_step;
+                mix_l *= level;
+                mix_r *= level;
+            }
+
+            // Feed the waveform views and the spectrum analyzer
+            osc_buffer_l[buffer_index] = mix_l;
+            osc_buffer_r[buffer_index] = mix_r;
+            buffer_index = (buffer_index + 1) % kWaveformBufferSize;
+            scope.Process(mix_l);
+            spectrum.Capture(0.5f * (mix_l + mix_r));
+
+            out_l[i] = mix_l;
+            out_r[i] = mix_r;
+        }
+
+        level = block_level;
+        scope.SetLowest(freq / max_ratio);
+
+        // Publish the block's final pitch for the tuner page
+        TunerSnapshot snap;
+        snap.input_freq = input_freq;
+        snap.quantized_freq = freq;
+        for (size_t j = 0; j < kNumSubharmonics; j++)
+        {
+            snap.sub_freqs[j] = freq / ratios[j];
+            snap.ratios[j] = ratios[j];
+        }
+        tuner_snapshot.Write(snap);
+    }
+};
+
+DTCM_MEM_SECTION SubharmonicEngine engine;
+
+// Helper: Fade the phosphor buffer by a quarter, four pixels per word. The
+// mask keeps each byte's shifted bits from spilling into its neighbour, and
+// v - v/4 never borrows, so no saturation is needed.
+void DecayPhosphor()
+{
+    uint8_t* bytes = &phosphor[0][0];
+    for (size_t i = 0; i < sizeof(phosphor); i += sizeof(uint32_t))
+    {
+        uint32_t w;
+        std::memcpy(&w, bytes + i, sizeof(w));
+        w -= (w >> 2) & 0x3F3F3F3Fu;
+        std::memcpy(bytes + i, &w, sizeof(w));
+    }
+}
+
+// Helper: Refresh the tuner text from the latest snapshot, formatting only
+// the lines whose displayed value changed
+void UpdateTunerText()
+{
+    TunerSnapshot snap = engine.tuner_snapshot.Read();
+    if (!(snap.quantized_freq > 0.0f && snap.input_freq > 0.0f))
+        return;
+
+    // Nearest 12-TET note and how far the quantized pitch sits from it
+    float midi = 12.0f * FastLog2(snap.quantized_freq / 440.0f) + 69.0f;
+    int note = static_cast<int>(floorf(midi + 0.5f));
+    int note_cents = static_cast<int>(floorf((midi - note) * 100.0f + 0.5f));
+    if (note != tuner_text.note || note_cents != tuner_text.note_cents)
+    {
+        tuner_text.note = note;
+        tuner_text.note_cents = note_cents;
+        int n = std::max(0, note);
+        std::snprintf(tuner_text.note_line, sizeof(tuner_text.note_line), "Note %s%d %+dc",
+                      note_labels[n % kNumNotes], n / static_cast<int>(kNumNotes), note_cents);
+    }
+
+    // Distance of the CV input from the note it was quantized to
+    int cv_cents = static_cast<int>(floorf(1200.0f * FastLog2(snap.input_freq / snap.quantized_freq) + 0.5f));
+    if (cv_cents != tuner_text.cv_cents || tuner_text.cv_line[0] == '\0')
+    {
+        tuner_text.cv_cents = cv_cents;
+        std::snprintf(tuner_text.cv_line, sizeof(tuner_text.cv_line), "CV   %+dc", cv_cents);
+    }
+
+    // Subharmonics two per line, to 0.1 Hz
+    for (size_t j = 0; j < kNumSubharmonics; j += 2)
+    {
+        int a = static_cast<int>(snap.sub_freqs[j] * 10.0f + 0.5f);
+        int b = static_cast<int>(snap.sub_freqs[j + 1] * 10.0f + 0.5f);
+        if (a == tuner_text.sub_tenths[j] && b == tuner_text.sub_tenths[j + 1])
+            continue;
+        tuner_text.sub_tenths[j] = a;
+        tuner_text.sub_tenths[j + 1] = b;
+        // Integer formatting, so newlib-nano needs no float printf support
+        std::snprintf(tuner_text.sub_lines[j / 2], sizeof(tuner_text.sub_lines[j / 2]), "/%d%4d.%d /%d%4d.%d",
+                      static_cast<int>(snap.ratios[j]), a / 10, a % 10,
+                      static_cast<int>(snap.ratios[j + 1]), b / 10, b % 10);
+    }
+}
+
+// Display Rendering
+// A frame is a prepare step, a number of independent drawing units and the
+// panel flush, so the scheduler can spread one frame over several main-loop
+// passes. The view is latched when the frame begins.
+struct FrameState
+{
+    bool menu = false;
+    DisplayMode mode = DisplayMode::WAVEFORM;
+    size_t unit = 0;
+    size_t units = 0;
+    bool active = false;
+    bool has_input = false;   // Frame reflects an encoder input
+    uint32_t input_us = 0;    // When that input was handled
+};
+
+FrameState frame;
+
+// Helper: Draw the current menu page
+void DrawMenu()
+{
+    patch.display.SetCursor(0, 0);
+    patch.display.WriteString("Menu:", Font_7x10, true);
+
+    patch.display.SetCursor(0, 15);
+    if (menu_state == MenuState::SCALE_SELECTION)
+    {
+        patch.display.WriteString("Scale: ", Font_7x10, false);
+        patch.display.WriteString(scale_names[current_scale_idx], Font_7x10, true);
+    }
+    else if (menu_state == MenuState::ROOT_NOTE_SELECTION)
+    {
+        int note_idx = root_note_midi % kNumNotes;
+        int octave = root_note_midi / kNumNotes;
+        char buf[32];
+        std::snprintf(buf, sizeof(buf), "Root: %s%d", note_labels[note_idx], octave);
+        patch.display.WriteString(buf, Font_7x10, true);
+    }
+    else if (menu_state == MenuState::TUNING_SELECTION)
+    {
+        const TuningSystem& system = tunings[current_tuning_idx];
+        patch.display.WriteString("Tuning: ", Font_7x10, false);
+        if (system.kind == TuningKind::SCALA && scala_tuning.num_degrees == 0)
+            patch.display.WriteString("No .scl", Font_7x10, true);
+        else
+            patch.display.WriteString(system.name, Font_7x10, true);
+    }
+    else if (menu_state == MenuState::MODE_SELECTION)
+    {
+        patch.display.WriteString("Mode: ", Font_7x10, false);
+        patch.display.WriteString(voice_mode_names[static_cast<size_t>(voice_mode)], Font_7x10, true);
+    }
+    else if (menu_state == MenuState::CALIBRATION)
+    {
+        char buf[32];
+        if (calibration_step < kNumCalibrationPoints)
+            std::snprintf(buf, sizeof(buf), "Cal: patch %dV", static_cast<int>(calibration_volts[calibration_step]));
+        else if (CalibrationValid(calibration_capture))
+            std::snprintf(buf, sizeof(buf), "Cal: saved");
+        else
+            std::snprintf(buf, sizeof(buf), "Cal: bad, turn <");
+        patch.display.WriteString(buf, Font_7x10, true);
+
+        patch.display.SetCursor(0, 30);
+        patch.display.WriteString("Knob CCW, turn >", Font_7x10, true);
+    }
+    else if (menu_state == MenuState::RECORDER)
+    {
+        char buf[32];
+        const char* hint = "Turn > to start";
+        uint32_t size = recorder.Size();
+        switch (recorder.state)
+        {
+            case RecorderState::IDLE:
+                std::snprintf(buf, sizeof(buf), "Rec: idle");
+                break;
+            case RecorderState::RECORDING:
+                if (size == kRecorderCapacity)
+                    std::snprintf(buf, sizeof(buf), "Rec: full");
+                else
+                    std::snprintf(buf, sizeof(buf), "Rec: %lu", static_cast<unsigned long>(size));
+                hint = "> save  < discard";
+                break;
+            case RecorderState::SAVING:
+                std::snprintf(buf, sizeof(buf), "Rec: saving %d%%",
+                              static_cast<int>(100ull * recorder.saved / std::max<uint32_t>(size, 1)));
+                hint = "";
+                break;
+            case RecorderState::SAVED:
+                std::snprintf(buf, sizeof(buf), "Rec: saved");
+                break;
+            case RecorderState::FAILED:
+                std::snprintf(buf, sizeof(buf), "Rec: SD error");
+                break;
+        }
+        patch.display.WriteString(buf, Font_7x10, true);
+
+        patch.display.SetCursor(0, 30);
+        patch.display.WriteString(hint, Font_7x10, true);
+    }
+    else if (menu_state == MenuState::TRACE)
+    {
+        char buf[32];
+        const TraceDump& d = trace_dump;
+        if (d.state == TraceDumpState::WRITING)
+            std::snprintf(buf, sizeof(buf), "Trace: %d%%",
+                          static_cast<int>(100ull * d.written / std::max<uint32_t>(d.header.num_events, 1)));
+        else if (d.state == TraceDumpState::DONE)
+            std::snprintf(buf, sizeof(buf), "Trace: %s", d.to_sd ? "saved" : "sent");
+        else if (d.state == TraceDumpState::FAILED)
+            std::snprintf(buf, sizeof(buf), "Trace: SD error");
+        else
+            std::snprintf(buf, sizeof(buf), "Trace: ready");
+        patch.display.WriteString(buf, Font_7x10, true);
+
+        patch.display.SetCursor(0, 30);
+        std::snprintf(buf, sizeof(buf), "Overruns: %lu",
+                      static_cast<unsigned long>(audio_overruns.load(std::memory_order_relaxed)));
+        patch.display.WriteString(buf, Font_7x10, true);
+    }
+    else if (menu_state == MenuState::FM_ROUTING)
+    {
+        patch.display.WriteString("FM: ", Font_7x10, false);
+        patch.display.WriteString(fm_presets[current_fm_preset].name, Font_7x10, true);
+    }
+    else if (menu_state == MenuState::FM_DEPTH)
+    {
+        char buf[32];
+        std::snprintf(buf, sizeof(buf), "FM depth: %d%%", fm_depth_percent);
+        patch.display.WriteString(buf, Font_7x10, true);
+    }
+    else if (menu_state == MenuState::SHAPER)
+    {
+        patch.display.WriteString("Shape: ", Font_7x10, false);
+        patch.display.WriteString(shaper_presets[current_shaper_preset].name, Font_7x10, true);
+    }
+    else if (menu_state == MenuState::SHAPER_DRIVE)
+    {
+        char buf[32];
+        std::snprintf(buf, sizeof(buf), "Drive: %d%%", shaper_drive_percent);
+        patch.display.WriteString(buf, Font_7x10, true);
+    }
+    else if (menu_state == MenuState::FILTER_CUTOFF)
+    {
+        char buf[32];
+        if (filter_cutoff_step >= kFilterCutoffSteps)
+            std::snprintf(buf, sizeof(buf), "Cutoff: open");
+        else
+            std::snprintf(buf, sizeof(buf), "Cutoff: %d Hz", static_cast<int>(FilterCutoffHz(filter_cutoff_step) + 0.5f));
+        patch.display.WriteString(buf, Font_7x10, true);
+    }
+    else if (menu_state == MenuState::FILTER_RESONANCE)
+    {
+        char buf[32];
+        std::snprintf(buf, sizeof(buf), "Resonance: %d%%", filter_resonance_percent);
+        patch.display.WriteString(buf, Font_7x10, true);
+    }
+    else if (menu_state == MenuState::ENVELOPE)
+    {
+        patch.display.WriteString("Env: ", Font_7x10, false);
+        patch.display.WriteString(envelope_presets[current_env_preset].name, Font_7x10, true);
+    }
+    else if (menu_state == MenuState::ENV_TIME)
+    {
+        char buf[32];
+        int ms = static_cast<int>(EnvelopeTime(env_time_step) * 1000.0f + 0.5f);
+        if (ms < 1000)
+            std::snprintf(buf, sizeof(buf), "Env time: %d ms", ms);
+        else
+            std::snprintf(buf, sizeof(buf), "Env time: %d.%02d s", ms / 1000, (ms % 1000) / 10);
+        patch.display.WriteString(buf, Font_7x10, true);
+    }
+    else if (menu_state == MenuState::ENV_CUTOFF)
+    {
+        char buf[32];
+        std::snprintf(buf, sizeof(buf), "Env>cut: %d.%d oct", env_cutoff_tenths / 10, env_cutoff_tenths % 10);
+        patch.display.WriteString(buf, Font_7x10, true);
+    }
+    else if (menu_state == MenuState::SEQ_RATE)
+    {
+        char buf[32];
+        std::snprintf(buf, sizeof(buf), "Seq: %d BPM", seq_bpm);
+        patch.display.WriteString(buf, Font_7x10, true);
+    }
+    else if (menu_state == MenuState::MOD_ROUTING)
+    {
+        patch.display.WriteString("Mod: ", Font_7x10, false);
+        patch.display.WriteString(mod_presets[current_mod_preset].name, Font_7x10, true);
+    }
+    else if (menu_state == MenuState::MOD_DEPTH)
+    {
+        char buf[32];
+        std::snprintf(buf, sizeof(buf), "Mod depth: %d%%", mod_depth_percent);
+        patch.display.WriteString(buf, Font_7x10, true);
+    }
+    else if (menu_state == MenuState::LFO_RATE)
+    {
+        char buf[32];
+        int centihertz = static_cast<int>(LfoRateHz(lfo_rate_step) * 100.0f + 0.5f);
+        std::snprintf(buf, sizeof(buf), "LFO: %d.%02d Hz", centihertz / 100, centihertz % 100);
+        patch.display.WriteString(buf, Font_7x10, true);
+    }
+    else if (menu_state == MenuState::PARTIALS)
+    {
+        char buf[32];
+        std::snprintf(buf, sizeof(buf), "Partials: %d", num_partials);
+        patch.display.WriteString(buf, Font_7x10, true);
+    }
+}
+
+// Helper: Clear the panel, latch the view and do its per-frame preparation;
+// returns the number of drawing units in the frame
+size_t BeginFrame()
+{
+    patch.display.Fill(false);
+    frame.menu = menu_active;
+    frame.mode = display_mode;
+    frame.unit = 0;
+
+    if (frame.menu)
+        return 1;
+
+    switch (frame.mode)
+    {
+        case DisplayMode::WAVEFORM:
+            // Take a finished trace and re-arm the trigger
+            if (engine.scope.state.load(std::memory_order_acquire) == ScopeCapture::State::READY)
+            {
+                std::copy(engine.scope.capture_min, engine.scope.capture_min + kScopeBuckets, scope_min.begin());
+                std::copy(engine.scope.capture_max, engine.scope.capture_max + kScopeBuckets, scope_max.begin());
+                engine.scope.state.store(ScopeCapture::State::ARMED, std::memory_order_release);
+            }
+            return kScopeBuckets / kColumnsPerUnit;
+
+        case DisplayMode::PHOSPHOR:
+            DecayPhosphor();
+            for (size_t i = 0; i < kWaveformBufferSize; i++)
+            {
+                int x = static_cast<int>((engine.osc_buffer_l[i] * 20.0f) + 64.0f);
+                int y = static_cast<int>((engine.osc_buffer_r[i] * 20.0f) + 32.0f);
+                if (x < 0 || x >= static_cast<int>(kDisplayWidth) || y < 0 || y >= static_cast<int>(kDisplayHeight))
+                    continue;
+                uint8_t& p = phosphor[y][x];
+                p = (p > 255 - kPhosphorHit) ? 255 : p + kPhosphorHit;
+            }
+            return kDisplayHeight / kRowsPerUnit;
+
+        case DisplayMode::SPECTRUM:
+            return kDisplayWidth / kColumnsPerUnit;
+
+        case DisplayMode::TUNER:
+            UpdateTunerText();
+            return 1;
+
+        case DisplayMode::XY:
+        default:
+            return 1;
+    }
+}
+
+// Helper: Draw one unit (a band of columns or rows) of the latched view
+void DrawFrameUnit(size_t unit)
+{
+    if (frame.menu)
+    {
+        DrawMenu();
+        return;
+    }
+
+    switch (frame.mode)
+    {
+        case DisplayMode::WAVEFORM:
+            // One vertical min/max span per bucket, stretched to meet the
+            // previous bucket so slow slopes stay connected
+            for (size_t i = unit * kColumnsPerUnit; i < (unit + 1) * kColumnsPerUnit; i++)
+            {
+                size_t prev = (i > 0) ? i - 1 : 0;
+                int x = static_cast<int>(i * (patch.display.Width() / kScopeBuckets));
+                int lo = ScopeY(scope_min[i]);
+                int hi = ScopeY(scope_max[i]);
+                patch.display.DrawLine(x, std::min(lo, ScopeY(scope_max[prev])), x,
+                                       std::max(hi, ScopeY(scope_min[prev])), true);
+            }
+            break;
+
+        case DisplayMode::XY:
+            for (size_t i = 0; i < kWaveformBufferSize; i++)
+            {
+                int x = static_cast<int>((engine.osc_buffer_l[i] * 20.0f) + 64.0f);
+                int y = static_cast<int>((engine.osc_buffer_r[i] * 20.0f) + 32.0f);
+                patch.display.DrawPixel(x, y, true);
+            }
+            break;
+
+        case DisplayMode::PHOSPHOR:
+            // Dither intensity down to the 1-bit panel, skipping words whose
+            // pixels are all below the lowest dither threshold
+            for (size_t y = unit * kRowsPerUnit; y < (unit + 1) * kRowsPerUnit; y++)
+            {
+                for (size_t x = 0; x < kDisplayWidth; x += 4)
+                {
+                    uint32_t word;
+                    std::memcpy(&word, &phosphor[y][x], sizeof(word));
+                    if ((word & 0xF8F8F8F8u) == 0)
+                        continue;
+                    for (size_t k = 0; k < 4; k++)
+                    {
+                        if (phosphor[y][x + k] > phosphor_dither[y & 3][(x + k) & 3])
+                            patch.display.DrawPixel(x + k, y, true);
+                    }
+                }
+            }
+            break;
+
+        case DisplayMode::TUNER:
+            patch.display.SetCursor(0, 0);
+            patch.display.WriteString(tuner_text.note_line, Font_7x10, true);
+            patch.display.SetCursor(0, 13);
+            patch.display.WriteString(tuner_text.cv_line, Font_7x10, true);
+            for (size_t k = 0; k < kNumSubharmonics / 2; k++)
+            {
+                patch.display.SetCursor(0, 30 + 13 * k);
+                patch.display.WriteString(tuner_text.sub_lines[k], Font_7x10, true);
+            }
+            break;
+
+        case DisplayMode::SPECTRUM:
+            for (size_t c = unit * kColumnsPerUnit; c < (unit + 1) * kColumnsPerUnit; c++)
+            {
+                if (engine.spectrum.columns[c] > 0)
+                    patch.display.DrawLine(c, kDisplayHeight - 1, c, kDisplayHeight - engine.spectrum.columns[c], true);
+            }
+            break;
+    }
+}
+
+// Pitch CV readings for the part of the block being rendered
+DTCM_MEM_SECTION float pitch_block[kMaxBlockSize];
+
+// Last quantized frequency written to the trace
+DTCM_MEM_SECTION float traced_freq;
+
+// Audio Callback
+// Reads the pitch CV and gate and runs the engine, with recording and tracing
+// around it
+ITCM_CODE void AudioCallback(AudioHandle::InputBuffer in, AudioHandle::OutputBuffer out, size_t size)
+{
+    const uint32_t block_start = sample_clock.load(std::memory_order_relaxed);
+    const bool recording = recorder.recording.load(std::memory_order_acquire);
+    const uint32_t start_tick = System::GetTick();
+    TracePoint(TraceType::BLOCK_START, 0, static_cast<uint16_t>(size));
+
+    // The envelope gate is read once per block
+    const bool gate = patch.gate_input[DaisyPatch::GATE_IN_1].State();
+    if (recording && static_cast<uint8_t>(gate) != recorder.last_gate)
+    {
+        recorder.last_gate = static_cast<uint8_t>(gate);
+        recorder.Record(block_start, ControlKind::GATE, gate ? 1 : 0, 0);
+    }
+    engine.SetGate(gate);
+
+    for (size_t done = 0; done < size;)
+    {
+        size_t n = std::min(size - done, kMaxBlockSize);
+
+        // Process Pitch CV from control
+        for (size_t i = 0; i < n; i++)
+        {
+            float pitch_cv = patch.controls[CTRL_PITCH].Process();
+            if (recording)
+            {
+                uint32_t value = static_cast<uint32_t>(std::fmax(0.0f, std::fmin(1.0f, pitch_cv)) * 65535.0f + 0.5f);
+                if (ControlRecorder::Moved(value, recorder.last_pitch))
+                {
+                    recorder.last_pitch = value;
+                    recorder.Record(block_start + done + i, ControlKind::PITCH, static_cast<uint16_t>(value), 0);
+                }
+            }
+            pitch_block[i] = pitch_cv;
+        }
+
+        engine.ProcessBlock(in[0] + done, pitch_block, out[0] + done, out[1] + done, n);
+        done += n;
+    }
+    sample_clock.store(block_start + size, std::memory_order_relaxed);
+
+    // Note changes are traced at block resolution
+    if (engine.freq != traced_freq)
+    {
+        traced_freq = engine.freq;
+        TracePoint(TraceType::NOTE, 0, static_cast<uint16_t>(std::fmin(traced_freq * 4.0f, 65535.0f)));
+    }
+
+    uint32_t elapsed = System::GetTick() - start_tick;
+    TracePoint(TraceType::BLOCK_END);
+    if (elapsed > trace_block_ticks)
+    {
+        audio_overruns.fetch_add(1, std::memory_order_relaxed);
+        uint32_t load = static_cast<uint32_t>(100ull * elapsed / trace_block_ticks);
+        TracePoint(TraceType::AUDIO_OVERRUN, 0, static_cast<uint16_t>(std::min<uint32_t>(load, 65535)));
+    }
+}
+
+// Helper: Hand the full UI parameter set to the engine
+void PublishParams()
+{
+    params_dirty = false;
+    ModulatedSettings m = ApplyModulation();
+    ui_params.voice_mode = voice_mode;
+    BuildFmMatrix(ui_params, current_fm_preset, static_cast<float>(m.fm_depth_percent) / kFmMaxDepth);
+    BuildShaper(ui_params, current_shaper_preset, static_cast<float>(shaper_drive_percent) / kShaperMaxDrive);
+    BuildFilter(ui_params, m.filter_cutoff_step, static_cast<float>(filter_resonance_percent) / kFilterMaxResonance);
+    BuildEnvelopes(ui_params, current_env_preset, EnvelopeTime(env_time_step), env_cutoff_tenths / 10.0f, seq_bpm);
+    BuildRatios(ui_params, m.ratio_steps);
+    BuildPartials(ui_params, static_cast<size_t>(num_partials));
+    engine.SetParams(ui_params);
+    engine.SetLevel(m.level);
+}
+
+// Initialize hardware, DSP state, calibration and tuning
+void InitModule()
+{
+    // Initialize Patch
+    patch.Init();
+
+    // Initialize DSP
+    engine.Init(patch.AudioSampleRate());
+
+    // Load pitch CV calibration, falling back to the nominal response
+    calibration_storage.Init(default_calibration);
+    CalibrationData& stored_calibration = calibration_storage.GetSettings();
+    if (!CalibrationValid(stored_calibration))
+        stored_calibration = default_calibration;
+    BuildCvTable(stored_calibration, ui_params.cv_table);
+
+    // Pick up a Scala tuning from the SD card if one is present
+    sd_mounted = MountSdCard();
+    if (sd_mounted)
+        LoadScalaFromSd();
+    RebuildTuningTable();
+    tuning_dirty = false;
+    PublishParams();
+
+    // Audio block period in trace ticks, the overrun threshold
+    trace_block_ticks = static_cast<uint32_t>(static_cast<uint64_t>(System::GetTickFreq()) * patch.AudioBlockSize()
+                                              / static_cast<uint64_t>(patch.AudioSampleRate()));
+
+    // Scheduler telemetry goes to the USB serial log
+    patch.seed.StartLog(false);
+}
+
+// Main-Loop Tasks
+// Apply queued encoder events at 1 kHz
+void TaskEncoder(uint32_t)
+{
+    UpdateEncoder();
+}
+
+// Helper: Run one control tick of the modulation matrix, marking the tuning
+// or the parameters dirty when a modulated value moves
+void UpdateModulation()
+{
+    if (mod_routes_dirty)
+    {
+        mod_routes_dirty = false;
+        mod_matrix.Load(current_mod_preset, static_cast<float>(mod_depth_percent) / kModMaxDepth);
+    }
+
+    // CV 2-4 are logged whenever they move, routed or not, so a replayed
+    // session can switch presets part way through
+    bool recording = recorder.recording.load(std::memory_order_relaxed);
+    uint32_t now = sample_clock.load(std::memory_order_relaxed);
+    for (size_t i = 0; i < 3; i++)
+    {
+        float cv = patch.controls[CTRL_CV2 + i].Process();
+        mod_matrix.sources[i] = 2.0f * cv - 1.0f;
+        uint32_t value = static_cast<uint32_t>(cv * 65535.0f);
+        if (recording && ControlRecorder::Moved(value, recorder.last_cv[i]))
+        {
+            recorder.last_cv[i] = value;
+            recorder.Record(now, ControlKind::CV, static_cast<uint16_t>(value), static_cast<int8_t>(i));
+        }
+    }
+    uint32_t now_us = System::GetUs();
+    float elapsed = std::fmin(static_cast<float>(now_us - mod_matrix.last_tick_us) * 1e-6f, kMaxControlGap);
+    mod_matrix.last_tick_us = now_us;
+    mod_matrix.AdvanceLfos(LfoRateHz(lfo_rate_step), elapsed);
+
+    ModulatedSettings before = ApplyModulation();
+    mod_matrix.Evaluate();
+    ModulatedSettings after = ApplyModulation();
+    if (after.scale != before.scale || after.root_note_midi != before.root_note_midi)
+        tuning_dirty = true;
+    if (after.fm_depth_percent != before.fm_depth_percent || after.filter_cutoff_step != before.filter_cutoff_step
+        || after.ratio_steps != before.ratio_steps)
+        params_dirty = true;
+    engine.SetLevel(after.level);
+}
+
+// Step the modulation matrix, recompile the tuning table after a scale, root
+// or tuning change, then hand any parameter change to the audio callback
+void TaskControl(uint32_t)
+{
+    UpdateModulation();
+    if (tuning_dirty)
+    {
+        tuning_dirty = false;
+        RebuildTuningTable();
+    }
+    if (params_dirty)
+        PublishParams();
+}
+
+// Helper: Write the next chunk of a recorded session to session.shr; the
+// header goes first and the file is closed after the last record
+void SaveSessionChunk()
+{
+    uint32_t total = recorder.Size();
+    UINT written = 0;
+
+    if (!recorder.file_open)
+    {
+        recorder.header.num_records = total;
+        if (!sd_mounted || f_open(&session_file, "session.shr", FA_WRITE | FA_CREATE_ALWAYS) != FR_OK)
+        {
+            recorder.state = RecorderState::FAILED;
+            return;
+        }
+        recorder.file_open = true;
+        if (f_write(&session_file, &recorder.header, sizeof(SessionHeader), &written) != FR_OK
+            || written != sizeof(SessionHeader))
+        {
+            f_close(&session_file);
+            recorder.file_open = false;
+            recorder.state = RecorderState::FAILED;
+            return;
+        }
+    }
+
+    uint32_t n = std::min<uint32_t>(total - recorder.saved, kRecorderSaveChunk);
+    if (n > 0
+        && (f_write(&session_file, &session_records[recorder.saved], n * sizeof(ControlRecord), &written) != FR_OK
+            || written != n * sizeof(ControlRecord)))
+    {
+        f_close(&session_file);
+        recorder.file_open = false;
+        recorder.state = RecorderState::FAILED;
+        return;
+    }
+    recorder.saved += n;
+
+    if (recorder.saved == total)
+    {
+        f_close(&session_file);
+        recorder.file_open = false;
+        recorder.state = RecorderState::SAVED;
+    }
+}
+
+// Helper: Snapshot the trace ring, oldest event first
+void StartTraceDump()
+{
+    TraceDump& d = trace_dump;
+    uint32_t head = trace_head.load(std::memory_order_relaxed);
+    uint32_t count = std::min<uint32_t>(head, kTraceSize);
+    for (uint32_t k = 0; k < count; k++)
+        d.events[k] = trace_ring[(head - count + k) & (kTraceSize - 1)];
+
+    std::memcpy(d.header.magic, "SHTR", sizeof(d.header.magic));
+    d.header.version = kTraceVersion;
+    d.header.event_size = sizeof(TraceEvent);
+    d.header.tick_freq = System::GetTickFreq();
+    d.header.block_ticks = trace_block_ticks;
+    d.header.num_events = count;
+    d.written = 0;
+    d.to_sd = sd_mounted;
+    d.state = TraceDumpState::WRITING;
+}
+
+// Helper: Write the next part of the trace snapshot to trace.bin, or print
+// it to the serial log as hex words
+// Helper: Abandon an SD dump after a failed or short write. Overruns stop
+// triggering dumps too, so a full card isn't written again on every one;
+// a manual dump re-arms them.
+void FailTraceDump()
+{
+    if (trace_dump.file_open)
+        f_close(&trace_file);
+    trace_dump.file_open = false;
+    trace_dump.state = TraceDumpState::FAILED;
+    trace_auto_armed = false;
+}
+
+void WriteTraceChunk()
+{
+    TraceDump& d = trace_dump;
+    uint32_t total = d.header.num_events;
+
+    if (!d.to_sd)
+    {
+        if (d.written == 0)
+        {
+            patch.seed.PrintLine("TRACE begin %lu %lu %lu", static_cast<unsigned long>(d.header.tick_freq),
+                                 static_cast<unsigned long>(d.header.block_ticks), static_cast<unsigned long>(total));
+        }
+        uint32_t end = std::min<uint32_t>(total, d.written + kTraceSerialChunk);
+        for (; d.written < end; d.written++)
+        {
+            patch.seed.PrintLine("TR %08lx %08lx", static_cast<unsigned long>(d.events[d.written].tick),
+                                 static_cast<unsigned long>(d.events[d.written].info));
+        }
+        if (d.written == total)
+        {
+            patch.seed.PrintLine("TRACE end");
+            d.state = TraceDumpState::DONE;
+        }
+        return;
+    }
+
+    UINT written = 0;
+    if (!d.file_open)
+    {
+        if (f_open(&trace_file, "trace.bin", FA_WRITE | FA_CREATE_ALWAYS) != FR_OK)
+        {
+            FailTraceDump();
+            return;
+        }
+        d.file_open = true;
+        if (f_write(&trace_file, &d.header, sizeof(TraceHeader), &written) != FR_OK
+            || written != sizeof(TraceHeader))
+        {
+            FailTraceDump();
+            return;
+        }
+    }
+
+    uint32_t n = std::min<uint32_t>(total - d.written, kTraceDumpChunk);
+    if (n > 0
+        && (f_write(&trace_file, &d.events[d.written], n * sizeof(TraceEvent), &written) != FR_OK
+            || written != n * sizeof(TraceEvent)))
+    {
+        FailTraceDump();
+        return;
+    }
+    d.written += n;
+
+    if (d.written == total)
+    {
+        f_close(&trace_file);
+        d.file_open = false;
+        d.state = TraceDumpState::DONE;
+    }
+}
+
+// Persist a completed calibration and save recorded sessions; SD and QSPI
+// writes are slow, so this runs at a low rate outside the input path
+void TaskStorage(uint32_t)
+{
+    if (calibration_save_pending)
+    {
+        calibration_save_pending = false;
+        if (CalibrationValid(calibration_capture))
+        {
+            calibration_storage.GetSettings() = calibration_capture;
+            calibration_storage.Save();
+            BuildCvTable(calibration_capture, ui_params.cv_table);
+            params_dirty = true;
+        }
+    }
+
+    if (recorder.state == RecorderState::SAVING)
+        SaveSessionChunk();
+
+    // Dump the trace on request, or on an overrun while auto-dump is armed
+    uint32_t overruns = audio_overruns.load(std::memory_order_relaxed);
+    bool overrun = overruns != audio_overruns_seen;
+    audio_overruns_seen = overruns;
+    if (trace_dump.state != TraceDumpState::WRITING && (trace_dump.requested || (overrun && trace_auto_armed)))
+    {
+        TracePoint(TraceType::DUMP, 0, trace_dump.requested ? 0 : 1);
+        trace_auto_armed = trace_dump.requested;
+        trace_dump.requested = false;
+        StartTraceDump();
+    }
+    if (trace_dump.state == TraceDumpState::WRITING)
+        WriteTraceChunk();
+}
+
+// Advance the spectrum FFT by one step while it is on screen
+void TaskAnalysis(uint32_t)
+{
+    if (!menu_active && display_mode == DisplayMode::SPECTRUM)
+        engine.spectrum.Process();
+}
+
+// Draw frame units until the budget is spent; the flush gets a slice of its
+// own. A new frame starts at the idle frame rate, or at once after an input.
+void TaskRender(uint32_t budget_us)
+{
+    uint32_t start = System::GetUs();
+
+    if (!frame.active)
+    {
+        if (!input_pending && start - last_frame_us < kFrameIntervalUs)
+            return;
+        last_frame_us = start;
+        frame.has_input = input_pending;
+        frame.input_us = input_pending_us;
+        input_pending = false;
+        frame.units = BeginFrame();
+        frame.active = true;
+    }
+
+    if (frame.unit < frame.units)
+    {
+        do
+            DrawFrameUnit(frame.unit++);
+        while (frame.unit < frame.units && System::GetUs() - start < budget_us);
+        return;
+    }
+
+    patch.display.Update();
+    frame.active = false;
+
+    if (frame.has_input)
+    {
+        ui_latency_last_us = System::GetUs() - frame.input_us;
+        ui_latency_worst_us = std::max(ui_latency_worst_us, ui_latency_last_us);
+    }
+}
+
+// Report scheduler health over the USB serial log once a second
+void TaskTelemetry(uint32_t)
+{
+    patch.seed.PrintLine("latency last %lu us worst %lu us, encoder drops %lu",
+                         static_cast<unsigned long>(ui_latency_last_us),
+                         static_cast<unsigned long>(ui_latency_worst_us),
+                         static_cast<unsigned long>(encoder_events.dropped));
+    for (const Task& task : tasks)
+    {
+        patch.seed.PrintLine("  %-9s worst %5lu us overruns %lu", task.name,
+                             static_cast<unsigned long>(task.worst_us),
+                             static_cast<unsigned long>(task.overruns));
+    }
+}
+
+Task tasks[kNumTasks] = {
+    {"encoder", TaskEncoder, 1000, 200},
+    {"control", TaskControl, 1000, 2000},
+    {"analysis", TaskAnalysis, 0, 300},
+    {"render", TaskRender, 0, 500},
+    {"storage", TaskStorage, 100000, 50000},
+    {"telemetry", TaskTelemetry, 1000000, 1000},
+};
+
+// Run every task that is due once, recording its worst run time and any
+// budget overruns
+void RunScheduler()
+{
+    for (Task& task : tasks)
+    {
+        uint32_t now = System::GetUs();
+        if (static_cast<int32_t>(now - task.next_us) < 0)
+            continue;
+
+        task.run(task.budget_us);
+
+        uint32_t elapsed = System::GetUs() - now;
+        task.worst_us = std::max(task.worst_us, elapsed);
+        if (elapsed > task.budget_us)
+        {
+            task.overruns++;
+            TracePoint(TraceType::TASK_OVERRUN, static_cast<uint8_t>(&task - tasks),
+                       static_cast<uint16_t>(std::min<uint32_t>(elapsed, 65535)));
+        }
+
+        // Keep to the period, but don't try to catch up after a stall
+        task.next_us += task.period_us;
+        if (static_cast<int32_t>(now - task.next_us) > 0)
+            task.next_us = now + task.period_us;
+    }
+}
+
+#if defined(SUBHARMONIC_HOST)
+// Run the scheduler until the render task has flushed a frame, for host tools
+// that step the firmware deterministically on the simulated clock
+// (System::Simulate). The encoder interrupt runs inline once per pass.
+void MainLoopPass()
+{
+    uint32_t frames = patch.display.FrameCount();
+    while (patch.display.FrameCount() == frames)
+    {
+        EncoderTimerCallback(nullptr);
+        RunScheduler();
     }
+}
+#endif
+
+#if !defined(SUBHARMONIC_HOST)
+int main(void)
+{
+    InitModule();
 
     // Start ADC and Audio
     patch.StartAdc();
     patch.StartAudio(AudioCallback);
+    StartEncoderTimer();
+    LockHeap();
 
     // Main Loop
     while (true)
-    {
-        UpdateEncoder();  // Handle encoder input in main loop
-        UpdateDisplay();  // Update display in main loop
-        delay(1);
-    }
+        RunScheduler();
 }
+#endif